@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
@@ -163,6 +164,29 @@ double get_counter()
 
 
 
+/*******************************************************
+ * read_counter() returns the counter itself, without the
+ * double arithmetic, for timing individual calls
+ *******************************************************/
+#if defined(__i386__) || defined(__x86_64__)
+unsigned long long read_counter(void)
+{
+    unsigned hi, lo;
+
+    asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+#else
+unsigned long long read_counter(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+
 /*******************************
  * Machine-independent functions
  ******************************/
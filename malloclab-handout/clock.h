@@ -15,6 +15,16 @@ double mhz(int verbose);
 /* Determine clock rate of processor, having more control over accuracy */
 double mhz_full(int verbose, int sleeptime);
 
+/* Read a raw timestamp, cheap enough to bracket a single call: the
+   time stamp counter on x86, nanoseconds elsewhere (COUNTER_UNIT) */
+unsigned long long read_counter(void);
+
+#if defined(__i386__) || defined(__x86_64__)
+#define COUNTER_UNIT "cycles"
+#else
+#define COUNTER_UNIT "ns"
+#endif
+
 /** Special counters that compensate for timer interrupt overhead */
 
 void start_comp_counter();
@@ -0,0 +1,514 @@
+/*
+ * gentrace.c - generate a synthetic trace for mdriver
+ *
+ * usage: gentrace [-b] [-n <ops>] [-s <dist>] [-l <dist>] [-r <pct>]
+ *                 [-g <growth>] [-m <bytes>] [-H <bytes>] [-S <seed>]
+ *                 [-o <file>]
+ *
+ * Each request frees the live block whose lifetime has run out, if
+ * there is one, and otherwise reallocs a random live block (-r percent
+ * of the time) or allocates a new one.  Block sizes are drawn from the
+ * -s distribution and lifetimes, counted in requests, from the -l one.
+ * With -H the live payload is held at or below the given size by
+ * freeing the blocks that are closest to dying early, so a trace can
+ * run at a steady heap of any size.  The blocks still live after the
+ * -n requests are freed at the end.
+ *
+ * A distribution is one of
+ *     fixed:N           always N
+ *     uniform:A,B       uniform over A..B
+ *     exp:M             exponential with mean M
+ *     power:A,B,ALPHA   power law (Pareto) with exponent ALPHA over A..B
+ *     bimodal:A,B,P     A with probability P percent, else B
+ *     inf               (lifetimes only) live until the end or until -H
+ *                       needs the space
+ * and a realloc growth pattern is one of
+ *     mul:F             multiply the size by F
+ *     add:N             add N bytes
+ *     new               draw a new size from the -s distribution
+ * A block that would grow past the largest request size (-m) is
+ * given a new size from the -s distribution instead.
+ *
+ * Byte counts and -n take a K, M or G suffix.  The same seed always
+ * gives the same trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/* A distribution that sizes or lifetimes are drawn from */
+typedef struct {
+    enum {FIXED, UNIFORM, EXP, POWER, BIMODAL, INF} kind;
+    double a, b, c;
+} dist_t;
+
+/* How a realloc changes the size of a block */
+typedef struct {
+    enum {MUL, ADD, NEW} kind;
+    double arg;
+} growth_t;
+
+/* Blocks that live forever have deaths above this, in random order */
+#define INF_DEATH (LLONG_MAX / 2)
+
+/* Per-id state of the blocks, indexed by trace id */
+static int *block_size;    /* payload bytes */
+static long long *death;   /* request number at which it is freed */
+static int *live_pos;      /* position in live */
+static int max_ids;
+
+/* Live blocks, as a binary min-heap on death and as a plain array */
+static int *dying;
+static int *live;
+static int num_live;
+
+/* The trace being built */
+static trace_t trace;
+static int max_ops;
+
+static unsigned long long rng_state = 1;
+
+static void parse_dist(char *spec, dist_t *d);
+static void parse_growth(char *spec, growth_t *g);
+static double parse_count(char *s);
+static double sample(dist_t *d);
+static double uniform(void);
+static unsigned long long rng(void);
+static int new_size(dist_t *sizes, int max_size);
+static void emit(int type, int index, int size);
+static int new_id(void);
+static void heap_push(int id);
+static int heap_pop(void);
+static void heap_sift_down(int i);
+static void live_remove(int id);
+static void write_text(trace_t *trace, char *path);
+static void *xrealloc(void *p, size_t n);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    dist_t sizes = {POWER, 16, 65536, 1.2};
+    dist_t lifetimes = {EXP, 10000, 0, 0};
+    growth_t growth = {MUL, 2};
+    double realloc_pct = 5;
+    double max_live = 0;      /* live payload ceiling (0 means none) */
+    int max_size = 16 << 20;  /* largest request */
+    int num_reqs = 1000000;
+    int binary = 0;
+    char *out = NULL;
+    long long t, life;
+    size_t live_bytes = 0, peak_bytes = 0;
+    int c, id, sz;
+
+    while ((c = getopt(argc, argv, "bn:s:l:r:g:m:H:S:o:h")) != EOF) {
+	switch (c) {
+	case 'b':
+	    binary = 1;
+	    break;
+	case 'n':
+	    num_reqs = (int)parse_count(optarg);
+	    break;
+	case 's':
+	    parse_dist(optarg, &sizes);
+	    if (sizes.kind == INF)
+		usage();
+	    break;
+	case 'l':
+	    parse_dist(optarg, &lifetimes);
+	    break;
+	case 'r':
+	    realloc_pct = atof(optarg);
+	    break;
+	case 'g':
+	    parse_growth(optarg, &growth);
+	    break;
+	case 'm':
+	    max_size = (int)parse_count(optarg);
+	    break;
+	case 'H':
+	    max_live = parse_count(optarg);
+	    break;
+	case 'S':
+	    rng_state = strtoull(optarg, NULL, 0) * 2 + 1; /* never 0 */
+	    break;
+	case 'o':
+	    out = optarg;
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc || num_reqs < 1 || max_size < 1)
+	usage();
+    if (binary && out == NULL) {
+	fprintf(stderr, "gentrace: -b needs -o\n");
+	exit(1);
+    }
+
+    for (t = 0; t < num_reqs; t++) {
+	if (num_live > 0 &&
+	    (death[dying[0]] <= t ||
+	     (max_live > 0 && live_bytes > max_live))) {
+	    /* free the block that is due, or closest to it */
+	    id = heap_pop();
+	    live_remove(id);
+	    live_bytes -= block_size[id];
+	    emit(FREE, id, 0);
+	} else if (num_live > 0 && uniform() * 100 < realloc_pct) {
+	    id = live[rng() % num_live];
+	    switch (growth.kind) {
+	    case MUL:
+		sz = (block_size[id] * growth.arg <= max_size) ?
+		    (int)(block_size[id] * growth.arg) : -1;
+		break;
+	    case ADD:
+		sz = (block_size[id] + growth.arg <= max_size) ?
+		    (int)(block_size[id] + growth.arg) : -1;
+		break;
+	    default:
+		sz = -1;
+	    }
+	    if (sz < 1)
+		sz = new_size(&sizes, max_size);
+	    live_bytes += sz - block_size[id];
+	    block_size[id] = sz;
+	    emit(REALLOC, id, sz);
+	} else {
+	    id = new_id();
+	    block_size[id] = new_size(&sizes, max_size);
+	    if (lifetimes.kind == INF) {
+		death[id] = INF_DEATH + (long long)(rng() >> 2);
+	    } else {
+		life = (long long)ceil(sample(&lifetimes));
+		death[id] = t + (life > 0 ? life : 1);
+	    }
+	    heap_push(id);
+	    live_pos[id] = num_live;
+	    live[num_live++] = id;
+	    live_bytes += block_size[id];
+	    emit(ALLOC, id, block_size[id]);
+	}
+	if (live_bytes > peak_bytes)
+	    peak_bytes = live_bytes;
+    }
+
+    /* free whatever is left */
+    while (num_live > 0) {
+	id = live[--num_live];
+	emit(FREE, id, 0);
+    }
+
+    trace.sugg_heapsize = peak_bytes > INT_MAX ? INT_MAX : (int)peak_bytes;
+    trace.num_reqs = trace.num_ops;
+    trace.weight = 1;
+    if (binary)
+	write_trace(&trace, out);
+    else
+	write_text(&trace, out);
+    fprintf(stderr, "%d ops, %d ids, peak live payload %lu KB\n",
+	    trace.num_ops, trace.num_ids, (unsigned long)(peak_bytes >> 10));
+    return 0;
+}
+
+/*
+ * parse_dist - parse a distribution spec (see the top of the file)
+ */
+static void parse_dist(char *spec, dist_t *d)
+{
+    int n = 0;
+
+    d->a = d->b = d->c = 0;
+    if (strcmp(spec, "inf") == 0) {
+	d->kind = INF;
+	return;
+    }
+    if (strncmp(spec, "fixed:", 6) == 0) {
+	d->kind = FIXED;
+	n = (sscanf(spec + 6, "%lf", &d->a) == 1);
+    } else if (strncmp(spec, "uniform:", 8) == 0) {
+	d->kind = UNIFORM;
+	n = (sscanf(spec + 8, "%lf,%lf", &d->a, &d->b) == 2 && d->a <= d->b);
+    } else if (strncmp(spec, "exp:", 4) == 0) {
+	d->kind = EXP;
+	n = (sscanf(spec + 4, "%lf", &d->a) == 1 && d->a > 0);
+    } else if (strncmp(spec, "power:", 6) == 0) {
+	d->kind = POWER;
+	n = (sscanf(spec + 6, "%lf,%lf,%lf", &d->a, &d->b, &d->c) == 3 &&
+	     d->a > 0 && d->a <= d->b && d->c > 0);
+    } else if (strncmp(spec, "bimodal:", 8) == 0) {
+	d->kind = BIMODAL;
+	n = (sscanf(spec + 8, "%lf,%lf,%lf", &d->a, &d->b, &d->c) == 3);
+    }
+    if (!n) {
+	fprintf(stderr, "gentrace: bad distribution %s\n", spec);
+	exit(1);
+    }
+}
+
+/*
+ * parse_growth - parse a realloc growth pattern
+ */
+static void parse_growth(char *spec, growth_t *g)
+{
+    int n = 0;
+
+    g->arg = 0;
+    if (strcmp(spec, "new") == 0) {
+	g->kind = NEW;
+	n = 1;
+    } else if (strncmp(spec, "mul:", 4) == 0) {
+	g->kind = MUL;
+	n = (sscanf(spec + 4, "%lf", &g->arg) == 1 && g->arg > 0);
+    } else if (strncmp(spec, "add:", 4) == 0) {
+	g->kind = ADD;
+	n = (sscanf(spec + 4, "%lf", &g->arg) == 1);
+    }
+    if (!n) {
+	fprintf(stderr, "gentrace: bad growth pattern %s\n", spec);
+	exit(1);
+    }
+}
+
+/*
+ * parse_count - parse a number with an optional K, M or G suffix
+ */
+static double parse_count(char *s)
+{
+    char *end;
+    double x = strtod(s, &end);
+
+    switch (*end) {
+    case 'k': case 'K': x *= 1 << 10; end++; break;
+    case 'm': case 'M': x *= 1 << 20; end++; break;
+    case 'g': case 'G': x *= 1 << 30; end++; break;
+    }
+    if (end == s || *end != '\0' || x < 0 || x > INT_MAX) {
+	fprintf(stderr, "gentrace: bad number %s\n", s);
+	exit(1);
+    }
+    return x;
+}
+
+/*
+ * sample - draw a value from d (HUGE_VAL for INF)
+ */
+static double sample(dist_t *d)
+{
+    double u = uniform();
+
+    switch (d->kind) {
+    case FIXED:
+	return d->a;
+    case UNIFORM:
+	return floor(d->a + u * (d->b - d->a + 1));
+    case EXP:
+	return -d->a * log(1 - u);
+    case POWER:
+	/* inverse of the Pareto distribution truncated to [a, b] */
+	return d->a * pow(1 - u * (1 - pow(d->a / d->b, d->c)), -1 / d->c);
+    case BIMODAL:
+	return (u * 100 < d->c) ? d->a : d->b;
+    default:
+	return HUGE_VAL;
+    }
+}
+
+/*
+ * new_size - draw a request size in 1..max_size
+ */
+static int new_size(dist_t *sizes, int max_size)
+{
+    double x = sample(sizes);
+
+    if (x < 1)
+	return 1;
+    return (x > max_size) ? max_size : (int)x;
+}
+
+/*
+ * uniform - a random double in [0, 1)
+ */
+static double uniform(void)
+{
+    return (rng() >> 11) * (1.0 / (1ULL << 53));
+}
+
+/*
+ * rng - xorshift64* generator
+ */
+static unsigned long long rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+/*
+ * emit - append a request to the trace
+ */
+static void emit(int type, int index, int size)
+{
+    traceop_t *op;
+
+    if (trace.num_ops == max_ops) {
+	if (max_ops > INT_MAX / 2) {
+	    fprintf(stderr, "gentrace: too many ops\n");
+	    exit(1);
+	}
+	max_ops = max_ops ? 2 * max_ops : 1 << 16;
+	trace.ops = xrealloc(trace.ops, max_ops * sizeof(traceop_t));
+    }
+    op = &trace.ops[trace.num_ops++];
+    op->type = type;
+    op->index = index;
+    op->size = size;
+    op->count = 0;
+}
+
+/*
+ * new_id - hand out the next trace id, growing the per-id arrays
+ */
+static int new_id(void)
+{
+    if (trace.num_ids == max_ids) {
+	max_ids = max_ids ? 2 * max_ids : 1 << 16;
+	block_size = xrealloc(block_size, max_ids * sizeof(int));
+	death = xrealloc(death, max_ids * sizeof(long long));
+	live_pos = xrealloc(live_pos, max_ids * sizeof(int));
+	dying = xrealloc(dying, max_ids * sizeof(int));
+	live = xrealloc(live, max_ids * sizeof(int));
+    }
+    return trace.num_ids++;
+}
+
+/*
+ * heap_push - add a block to the dying heap (num_live not yet counting it)
+ */
+static void heap_push(int id)
+{
+    int i = num_live, parent;
+
+    while (i > 0) {
+	parent = (i - 1) / 2;
+	if (death[dying[parent]] <= death[id])
+	    break;
+	dying[i] = dying[parent];
+	i = parent;
+    }
+    dying[i] = id;
+}
+
+/*
+ * heap_pop - remove and return the block that dies first.  The caller
+ *     removes it from live, which shrinks num_live.
+ */
+static int heap_pop(void)
+{
+    int id = dying[0];
+
+    dying[0] = dying[num_live - 1];
+    heap_sift_down(0);
+    return id;
+}
+
+/*
+ * heap_sift_down - restore the heap below position i (size num_live - 1,
+ *     as heap_pop has just taken one block out)
+ */
+static void heap_sift_down(int i)
+{
+    int n = num_live - 1, child, id = dying[i];
+
+    while ((child = 2 * i + 1) < n) {
+	if (child + 1 < n && death[dying[child + 1]] < death[dying[child]])
+	    child++;
+	if (death[id] <= death[dying[child]])
+	    break;
+	dying[i] = dying[child];
+	i = child;
+    }
+    if (i < n)
+	dying[i] = id;
+}
+
+/*
+ * live_remove - take a block out of the live array
+ */
+static void live_remove(int id)
+{
+    int last = live[--num_live];
+
+    live[live_pos[id]] = last;
+    live_pos[last] = live_pos[id];
+}
+
+/*
+ * write_text - write the trace as a .rep file (to stdout if path is NULL)
+ */
+static void write_text(trace_t *trace, char *path)
+{
+    FILE *out = stdout;
+    traceop_t *op;
+    int i;
+
+    if (path != NULL && (out = fopen(path, "w")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    fprintf(out, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize,
+	    trace->num_ids, trace->num_ops, trace->weight);
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	    fprintf(out, "a %d %d\n", op->index, op->size);
+	    break;
+	case REALLOC:
+	    fprintf(out, "r %d %d\n", op->index, op->size);
+	    break;
+	default:
+	    fprintf(out, "f %d\n", op->index);
+	}
+    }
+    if (fclose(out) != 0) {
+	perror(path ? path : "stdout");
+	exit(1);
+    }
+}
+
+static void *xrealloc(void *p, size_t n)
+{
+    if ((p = realloc(p, n)) == NULL) {
+	fprintf(stderr, "gentrace: out of memory\n");
+	exit(1);
+    }
+    return p;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: gentrace [-b] [-n <ops>] [-s <dist>] [-l <dist>] [-r <pct>]\n");
+    fprintf(stderr, "                [-g <growth>] [-m <bytes>] [-H <bytes>] [-S <seed>]\n");
+    fprintf(stderr, "                [-o <file>]\n");
+    fprintf(stderr, "Generate a synthetic mdriver trace.\n");
+    fprintf(stderr, "\t-b           Write the binary format (needs -o).\n");
+    fprintf(stderr, "\t-n <ops>     Requests before the final frees (1000000).\n");
+    fprintf(stderr, "\t-s <dist>    Request sizes (power:16,65536,1.2).\n");
+    fprintf(stderr, "\t-l <dist>    Lifetimes in requests (exp:10000).\n");
+    fprintf(stderr, "\t-r <pct>     Percent of requests that are reallocs (5).\n");
+    fprintf(stderr, "\t-g <growth>  How a realloc resizes a block (mul:2).\n");
+    fprintf(stderr, "\t-m <bytes>   Largest request (16M).\n");
+    fprintf(stderr, "\t-H <bytes>   Keep the live payload below this.\n");
+    fprintf(stderr, "\t-S <seed>    Random seed.\n");
+    fprintf(stderr, "\t-o <file>    Output file (stdout).\n");
+    fprintf(stderr, "Distributions: fixed:N uniform:A,B exp:M power:A,B,ALPHA\n");
+    fprintf(stderr, "               bimodal:A,B,P inf\n");
+    fprintf(stderr, "Growth: mul:F add:N new\n");
+    exit(1);
+}
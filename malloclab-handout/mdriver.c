@@ -15,11 +15,16 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
+#include "trace.h"
+#include "perfctr.h"
 
 /**********************
  * Constants and macros
@@ -31,37 +36,36 @@
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
+
+/* 
+ * Latency histograms (-L) have LAT_SUB buckets for each power of two,
+ * so a percentile read from one is within 1/LAT_SUB of the true value.
+ */
+#define LAT_SUB_BITS   3
+#define LAT_SUB        (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS    (64 * LAT_SUB)
+#define NUM_OP_TYPES   5 /* ALLOC, FREE, REALLOC, BATCH_ALLOC, BATCH_FREE */
+
+/* Counted runs of each trace (-P); the fastest one is reported */
+#define PERF_RUNS      3
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* 
+ * Records the extent of each block's payload.  The ranges form a treap
+ * keyed by lo, with priorities hashed from lo.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    unsigned prio;         /* treap priority */
+    struct range_t *left;  /* ranges below lo */
+    struct range_t *right; /* ranges above hi */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -72,6 +76,13 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Distribution of the latencies of one type of request */
+typedef struct {
+    unsigned long count[LAT_BUCKETS]; /* requests in each bucket */
+    unsigned long n;                  /* requests timed */
+    unsigned long long max;           /* the slowest one */
+} latency_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,10 +92,19 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    mm_stats_t heap; /* allocator state at the payload peak (with -v) */
+    latency_t lat[NUM_OP_TYPES]; /* per request type (with -L) */
+    perf_counts_t perf;          /* hardware event counts (with -P) */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* What a worker process sends back for its trace (with -j) */
+typedef struct {
+    stats_t stats;
+    int errors;      /* errors the worker found */
+} result_t;
+
 /********************
  * Global variables
  *******************/
@@ -95,6 +115,11 @@ char msg[MAXLINE];      /* for whenever we need to compose an error message */
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* Names of the request types, indexed by traceop_t.type */
+static char *op_names[NUM_OP_TYPES] = {
+    "malloc", "free", "realloc", "malloc_batch", "free_batch"
+};
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -110,10 +135,7 @@ static int add_range(range_t **ranges, char *lo, int size,
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
-
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
+static unsigned range_prio(char *lo);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -122,15 +144,33 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   mm_stats_t *heapstats);
 static void eval_mm_speed(void *ptr);
+static void replay_mm(trace_t *trace, int num_ops);
+static void eval_mm_latency(trace_t *trace, latency_t *lat);
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  int latency, int counters);
+static void eval_mm_parallel(char **tracefiles, int num_tracefiles,
+			     stats_t *stats, int latency, int counters,
+			     int jobs);
+
+/* These functions maintain and query latency histograms */
+static void lat_add(latency_t *lat, unsigned long long t);
+static unsigned long long lat_percentile(latency_t *lat, double p);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printheapstats(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printrate(double count, double ops, int width, int prec);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
+static ssize_t readn(int fd, void *buf, size_t n);
+static ssize_t writen(int fd, void *buf, size_t n);
 
 /**************
  * Main: routine
@@ -142,7 +182,6 @@ int main(int argc, char **argv)
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
     trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */ 
@@ -150,6 +189,9 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int latency = 0;     /* If set, time each mm request (set by -L) */
+    int jobs = 1;        /* Traces evaluated at once (set by -j) */
+    int counters = 0;    /* If set, count hardware events (set by -P) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +200,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:j:hvVgalLP")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +226,19 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'L': /* Report per-request latencies of mm malloc */
+            latency = 1;
+            break;
+        case 'P': /* Report hardware event counts of mm malloc */
+            counters = 1;
+            break;
+        case 'j': /* Evaluate up to this many traces at once */
+            jobs = atoi(optarg);
+            if (jobs < 1) {
+                usage();
+                exit(1);
+            }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -252,8 +307,10 @@ int main(int argc, char **argv)
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
 	for (i=0; i < num_tracefiles; i++) {
+	    if (verbose > 1)
+		printf("Reading tracefile: %s\n", tracefiles[i]);
 	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
+	    libc_stats[i].ops = trace->num_reqs;
 	    if (verbose > 1)
 		printf("Checking libc malloc for correctness, ");
 	    libc_stats[i].valid = eval_libc_valid(trace, i);
@@ -288,29 +345,30 @@ int main(int argc, char **argv)
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+    if (jobs > 1)
+	eval_mm_parallel(tracefiles, num_tracefiles, mm_stats,
+			 latency, counters, jobs);
+    else {
+	for (i=0; i < num_tracefiles; i++)
+	    eval_mm_trace(tracefiles[i], i, &mm_stats[i], latency, counters);
     }
 
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
+	printf("\nAllocator statistics for mm malloc:\n");
+	printheapstats(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (latency) {
+	printf("\nLatency of mm malloc requests (%s):\n", COUNTER_UNIT);
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (counters) {
+	printf("\nHardware events per mm malloc request:\n");
+	printcounters(num_tracefiles, mm_stats);
 	printf("\n");
     }
 
@@ -369,20 +427,20 @@ int main(int argc, char **argv)
 /*****************************************************************
  * The following routines manipulate the range list, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, **link, **left, **right;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -395,19 +453,24 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or within
+       one of the regions the package mapped with mem_mmap */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
+    /* 
+     * The payload must not overlap any other payloads.  The ranges
+     * are disjoint, so only the one with the largest lo <= hi can
+     * overlap; it is on the search path for hi.
+     */
+    for (p = *ranges;  p != NULL;  p = (p->lo <= hi) ? p->right : p->left) {
+        if (p->lo <= hi && p->hi >= lo) {
 	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
 		    lo, hi, p->lo, p->hi);
 	    malloc_error(tracenum, opnum, msg);
@@ -417,14 +480,35 @@ static int add_range(range_t **ranges, char *lo, int size,
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 	unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->prio = range_prio(lo);
+
+    /* Go down past the ranges of higher priority ... */
+    link = ranges;
+    while (*link != NULL && (*link)->prio > p->prio)
+	link = (lo < (*link)->lo) ? &(*link)->left : &(*link)->right;
+
+    /* ... and split the subtree there into p's two children */
+    left = &p->left;
+    right = &p->right;
+    while (*link != NULL) {
+	if ((*link)->lo < lo) {
+	    *left = *link;
+	    left = &(*link)->right;
+	    *link = *left;
+	} else {
+	    *right = *link;
+	    right = &(*link)->left;
+	    *link = *right;
+	}
+    }
+    *left = *right = NULL;
+    *link = p;
     return 1;
 }
 
@@ -433,19 +517,30 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
+    range_t *p, *left, *right;
+    range_t **link = ranges;
+
+    while ((p = *link) != NULL && p->lo != lo)
+	link = (lo < p->lo) ? &p->left : &p->right;
+    if (p == NULL)
+	return;
+
+    /* Replace p by the merge of its two subtrees */
+    left = p->left;
+    right = p->right;
+    while (left != NULL && right != NULL) {
+	if (left->prio > right->prio) {
+	    *link = left;
+	    link = &left->right;
+	    left = *link;
+	} else {
+	    *link = right;
+	    link = &right->left;
+	    right = *link;
+	}
     }
+    *link = (left != NULL) ? left : right;
+    free(p);
 }
 
 /*
@@ -453,118 +548,30 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free(p);
     *ranges = NULL;
 }
 
-
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
 /*
- * read_trace - read a trace file and store it in memory
+ * range_prio - treap priority of the range starting at lo, a hash of
+ *     the address so that the tree stays balanced whatever the order
+ *     the blocks come in
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static unsigned range_prio(char *lo)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
+    unsigned long long x = (unsigned long)lo;
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
+    x = (x ^ (x >> 31)) * 0x7fb5d329728ea185ULL;
+    x = (x ^ (x >> 27)) * 0x81dadef4bc2dd44dULL;
+    return (unsigned)(x ^ (x >> 33));
 }
 
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
-}
 
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
@@ -579,6 +586,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     int i, j;
     int index;
     int size;
+    size_t count;
     int oldsize;
     char *newp;
     char *oldp;
@@ -631,8 +639,16 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case REALLOC: /* mm_realloc */
 	    
-	    /* Call the student's realloc */
+	    /* A realloc too large to satisfy must fail and leave the
+	     * block alone; the data check below sees if it didn't */
 	    oldp = trace->blocks[index];
+	    if (mm_realloc(oldp, (size_t)-4) != NULL) {
+		malloc_error(tracenum, i, "mm_realloc of a huge size "
+			     "did not fail.");
+		return 0;
+	    }
+
+	    /* Call the student's realloc */
 	    if ((newp = mm_realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
@@ -653,7 +669,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -674,6 +690,33 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    mm_free(p);
 	    break;
 
+	case BATCH_ALLOC: /* mm_malloc_batch */
+
+	    /* The batch fills in blocks[index .. index+count-1] */
+	    count = trace->ops[i].count;
+	    if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) 
+		!= count) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+
+	    /* Check and fill each block as for mm_malloc */
+	    for (j = 0; j < count; j++) {
+		p = trace->blocks[index + j];
+		if (add_range(ranges, p, size, tracenum, i) == 0)
+		    return 0;
+		memset(p, (index + j) & 0xFF, size);
+		trace->block_sizes[index + j] = size;
+	    }
+	    break;
+
+	case BATCH_FREE: /* mm_free_batch */
+	    count = trace->ops[i].count;
+	    for (j = 0; j < count; j++)
+		remove_range(ranges, trace->blocks[index + j]);
+	    mm_free_batch((void **)&trace->blocks[index], count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
@@ -689,21 +732,31 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   largest size of the heap in bytes while running the student's 
+ *   malloc package on the trace. The package may give memory back 
+ *   with mem_trim(), so we use the high water mark of the brk pointer 
+ *   that memlib keeps rather than the final heap size. 
+ *
+ *   If heapstats is not NULL, it receives the free lists as they were
+ *   at the payload peak and the allocator's counters for the whole 
+ *   trace.  Walking the free lists is slow, so rather than at every
+ *   new peak we note where the final peak was and replay the trace up
+ *   to there once.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   mm_stats_t *heapstats)
 {   
-    int i;
+    int i, j;
     int index;
+    size_t count;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    int peak_op = 0;     /* request after which the payload peaked */
     char *p;
     char *newp, *oldp;
+    double util;
+    mm_stats_t endstats;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
@@ -729,6 +782,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    total_size += size;
 	    
 	    /* Update statistics */
+	    if (total_size > max_total_size)
+		peak_op = i;
 	    max_total_size = (total_size > max_total_size) ?
 		total_size : max_total_size;
 	    break;
@@ -751,6 +806,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    total_size += (newsize - oldsize);
 	    
 	    /* Update statistics */
+	    if (total_size > max_total_size)
+		peak_op = i;
 	    max_total_size = (total_size > max_total_size) ?
 		total_size : max_total_size;
 	    break;
@@ -768,13 +825,54 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+	case BATCH_ALLOC: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    count = trace->ops[i].count;
+
+	    if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) 
+		!= count)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = 0; j < count; j++)
+		trace->block_sizes[index + j] = size;
+	    total_size += size * count;
+
+	    /* Update statistics */
+	    if (total_size > max_total_size)
+		peak_op = i;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+	case BATCH_FREE: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+	    for (j = 0; j < count; j++)
+		total_size -= trace->block_sizes[index + j];
+	    mm_free_batch((void **)&trace->blocks[index], count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    util = (double)max_total_size / (double)mem_peak_heapsize();
+
+    /* The counters cover the whole trace, not just up to the peak */
+    if (heapstats != NULL) {
+	mm_stats(&endstats);
+	replay_mm(trace, peak_op + 1);
+	mm_stats(heapstats);
+	heapstats->sbrk_calls = endstats.sbrk_calls;
+	heapstats->sbrk_bytes = endstats.sbrk_bytes;
+	heapstats->coalesces = endstats.coalesces;
+	heapstats->splits = endstats.splits;
+	heapstats->realloc_inplace = endstats.realloc_inplace;
+    }
+
+    return util;
 }
 
 
@@ -783,25 +881,36 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr)
+{
+    trace_t *trace = ((speed_t *)ptr)->trace;
+
+    replay_mm(trace, trace->num_ops);
+}
+
+/*
+ * replay_mm - Start the mm package afresh and run the first num_ops
+ *    requests of the trace
+ */
+static void replay_mm(trace_t *trace, int num_ops)
 {
     int i, index, size, newsize;
+    size_t count;
     char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
     if (mm_init() < 0) 
-	app_error("mm_init failed in eval_mm_speed");
+	app_error("mm_init failed in replay_mm");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
+    for (i = 0;  i < num_ops;  i++)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
             if ((p = mm_malloc(size)) == NULL)
-		app_error("mm_malloc error in eval_mm_speed");
+		app_error("mm_malloc error in replay_mm");
             trace->blocks[index] = p;
             break;
 
@@ -810,7 +919,7 @@ static void eval_mm_speed(void *ptr)
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[index];
             if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc error in eval_mm_speed");
+		app_error("mm_realloc error in replay_mm");
             trace->blocks[index] = newp;
             break;
 
@@ -820,11 +929,193 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+	case BATCH_ALLOC: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+	    if (mm_malloc_batch(trace->ops[i].size, count, 
+				(void **)&trace->blocks[index]) != count)
+		app_error("mm_malloc_batch error in replay_mm");
+	    break;
+
+	case BATCH_FREE: /* mm_free_batch */
+	    mm_free_batch((void **)&trace->blocks[trace->ops[i].index], 
+			  trace->ops[i].count);
+	    break;
+
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in replay_mm");
         }
 }
 
+/*
+ * eval_mm_latency - Run the trace once more, timing each request with
+ *    the raw counter, and add the times to the histogram of its type
+ *    in lat[].  The counter's own cost is subtracted.
+ */
+static void eval_mm_latency(trace_t *trace, latency_t *lat)
+{
+    int i, index;
+    size_t count;
+    char *p;
+    traceop_t *op;
+    unsigned long long start, t, overhead = ~0ULL;
+
+    /* The cheapest of a few back-to-back reads is the counter's cost */
+    for (i = 0; i < 100; i++) {
+	start = read_counter();
+	t = read_counter() - start;
+	if (t < overhead)
+	    overhead = t;
+    }
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = &trace->ops[i];
+	index = op->index;
+	start = read_counter();
+        switch (op->type) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(trace->blocks[index], op->size)) == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            mm_free(trace->blocks[index]);
+            break;
+
+	case BATCH_ALLOC: /* mm_malloc_batch */
+	    count = op->count;
+	    if (mm_malloc_batch(op->size, count, 
+				(void **)&trace->blocks[index]) != count)
+		app_error("mm_malloc_batch error in eval_mm_latency");
+	    break;
+
+	case BATCH_FREE: /* mm_free_batch */
+	    mm_free_batch((void **)&trace->blocks[index], op->count);
+	    break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+        }
+	t = read_counter() - start;
+	lat_add(&lat[op->type], t > overhead ? t - overhead : 0);
+    }
+}
+
+/*
+ * eval_mm_trace - Read trace tracenum from tracefile and check, measure
+ *    and time the mm package on it, filling in *stats.
+ */
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  int latency, int counters)
+{
+    trace_t *trace;
+    range_t *ranges = NULL;  /* keeps track of block extents */
+    speed_t speed_params;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", tracefile);
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_reqs;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, tracenum, &ranges,
+				   verbose ? &stats->heap : NULL);
+	speed_params.trace = trace;
+	speed_params.ranges = ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	if (latency)
+	    eval_mm_latency(trace, stats->lat);
+	if (counters)
+	    perf_measure(eval_mm_speed, &speed_params, PERF_RUNS,
+			 &stats->perf);
+    }
+    clear_ranges(&ranges);
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_parallel - Evaluate each trace in a forked worker process,
+ *    with at most jobs of them running at once.  A worker sends its
+ *    stats and error count back over a pipe.  The results are collected
+ *    in trace order, and a worker that dies leaves its trace invalid.
+ */
+static void eval_mm_parallel(char **tracefiles, int num_tracefiles,
+			     stats_t *stats, int latency, int counters,
+			     int jobs)
+{
+    int i, next = 0, status, fd[2];
+    int *fds;
+    pid_t *pids;
+    result_t res;
+
+    if ((fds = (int *)malloc(num_tracefiles * sizeof(int))) == NULL ||
+	(pids = (pid_t *)malloc(num_tracefiles * sizeof(pid_t))) == NULL)
+	unix_error("malloc failed in eval_mm_parallel");
+
+    for (i = 0; i < num_tracefiles; i++) {
+	/* Keep up to jobs workers running */
+	for (; next < num_tracefiles && next < i + jobs; next++) {
+	    if (pipe(fd) < 0)
+		unix_error("pipe failed in eval_mm_parallel");
+	    fflush(stdout); /* or the worker would print our output again */
+	    if ((pids[next] = fork()) < 0)
+		unix_error("fork failed in eval_mm_parallel");
+	    if (pids[next] == 0) {
+		close(fd[0]);
+		memset(&res, 0, sizeof(res));
+		errors = 0;
+		eval_mm_trace(tracefiles[next], next, &res.stats, latency,
+			      counters);
+		res.errors = errors;
+		fflush(stdout);
+		_exit(writen(fd[1], &res, sizeof(res)) < 0);
+	    }
+	    close(fd[1]);
+	    fds[next] = fd[0];
+	}
+
+	/* Then wait for trace i */
+	if (readn(fds[i], &res, sizeof(res)) == sizeof(res)) {
+	    stats[i] = res.stats;
+	    errors += res.errors;
+	}
+	close(fds[i]);
+	if (waitpid(pids[i], &status, 0) < 0)
+	    unix_error("waitpid failed in eval_mm_parallel");
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	    errors++;
+	    if (WIFSIGNALED(status))
+		printf("ERROR [trace %d]: worker killed by signal %d\n",
+		       i, WTERMSIG(status));
+	    else
+		printf("ERROR [trace %d]: worker exited with status %d\n",
+		       i, WEXITSTATUS(status));
+	    stats[i].valid = 0;
+	}
+    }
+    free(fds);
+    free(pids);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -833,7 +1124,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -861,6 +1152,21 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+	case BATCH_ALLOC: /* one malloc per block */
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
+	case BATCH_FREE: /* one free per block */
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -876,7 +1182,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -906,6 +1212,22 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+	case BATCH_ALLOC: /* one malloc per block */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+		trace->blocks[index + j] = p;
+	    }
+	    break;
+
+	case BATCH_FREE: /* one free per block */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[index + j]);
+	    break;
 	}
     }
 }
@@ -972,6 +1294,202 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printheapstats - prints the allocator statistics gathered by 
+ *     eval_mm_util for each trace, and with -V the free blocks in 
+ *     each size class
+ */
+static void printheapstats(int n, stats_t *stats)
+{
+    int i, j;
+    mm_stats_t *h;
+
+    printf("%5s%7s%9s%9s%7s%8s%7s%9s%9s%6s\n", 
+	   "trace", "sbrks", "sbrk KB", "coalesce", "split", "inplace",
+	   "free", "free KB", "max KB", "frag");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	h = &stats[i].heap;
+	printf("%2d%10lu%9.0f%9lu%7lu%8lu%7lu%9.1f%9.1f%5.0f%%\n",
+	       i,
+	       (unsigned long)h->sbrk_calls,
+	       h->sbrk_bytes/1024.0,
+	       (unsigned long)h->coalesces,
+	       (unsigned long)h->splits,
+	       (unsigned long)h->realloc_inplace,
+	       (unsigned long)h->free_blocks,
+	       h->free_total/1024.0,
+	       h->largest_free/1024.0,
+	       h->fragmentation*100.0);
+	if (verbose > 1) {
+	    for (j=0; j < MM_STATS_CLASSES; j++) {
+		if (h->free_count[j] > 0)
+		    printf("%12s%3d:%7lu blocks%9lu bytes\n", "class", j,
+			   (unsigned long)h->free_count[j],
+			   (unsigned long)h->free_bytes[j]);
+	    }
+	}
+    }
+}
+
+/*
+ * printlatency - prints the median, 99th percentile and maximum latency
+ *     of each type of request in each trace, and over all the traces
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i, j, b;
+    latency_t *total;
+
+    if ((total = calloc(NUM_OP_TYPES, sizeof(latency_t))) == NULL)
+	unix_error("calloc failed in printlatency");
+
+    printf("%5s  %-13s%9s%9s%9s%11s\n", 
+	   "trace", "request", "count", "p50", "p99", "max");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	for (j=0; j < NUM_OP_TYPES; j++) {
+	    latency_t *lat = &stats[i].lat[j];
+
+	    if (lat->n == 0)
+		continue;
+	    printf("%2d     %-13s%9lu%9llu%9llu%11llu\n", i, op_names[j],
+		   lat->n, lat_percentile(lat, 0.50), lat_percentile(lat, 0.99),
+		   lat->max);
+	    for (b=0; b < LAT_BUCKETS; b++)
+		total[j].count[b] += lat->count[b];
+	    total[j].n += lat->n;
+	    if (lat->max > total[j].max)
+		total[j].max = lat->max;
+	}
+    }
+    for (j=0; j < NUM_OP_TYPES; j++) {
+	if (total[j].n == 0)
+	    continue;
+	printf("%-7s%-13s%9lu%9llu%9llu%11llu\n", "Total", op_names[j],
+	       total[j].n, lat_percentile(&total[j], 0.50),
+	       lat_percentile(&total[j], 0.99), total[j].max);
+    }
+    free(total);
+}
+
+/*
+ * printcounters - Print the hardware event counts of the mm package,
+ *     per request, for each trace and for all of them together.  A
+ *     "-" marks an event that could not be counted.
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, j;
+    double ops = 0, secs = 0, total[NUM_COUNTERS];
+    perf_counts_t *perf;
+
+    for (j=0; j < NUM_COUNTERS; j++)
+	total[j] = 0;
+    printf("%5s%10s%10s%10s%7s%10s%10s%10s\n", "trace", "ns",
+	   "instr", "cycles", "IPC", "L1D miss", "LLC miss", "br miss");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	perf = &stats[i].perf;
+	printf("%2d   ", i);
+	printrate(perf->secs * 1e9, stats[i].ops, 10, 1);
+	printrate(perf->count[CTR_INSTRUCTIONS], stats[i].ops, 10, 1);
+	printrate(perf->count[CTR_CYCLES], stats[i].ops, 10, 1);
+	printrate(perf->count[CTR_INSTRUCTIONS] < 0 ?
+		  -1 : perf->count[CTR_INSTRUCTIONS],
+		  perf->count[CTR_CYCLES], 7, 2);
+	printrate(perf->count[CTR_L1D_MISSES], stats[i].ops, 10, 3);
+	printrate(perf->count[CTR_LLC_MISSES], stats[i].ops, 10, 3);
+	printrate(perf->count[CTR_BRANCH_MISSES], stats[i].ops, 10, 3);
+	printf("\n");
+
+	ops += stats[i].ops;
+	secs += perf->secs;
+	for (j=0; j < NUM_COUNTERS; j++) {
+	    if (perf->count[j] < 0 || total[j] < 0)
+		total[j] = -1;
+	    else
+		total[j] += perf->count[j];
+	}
+    }
+    if (ops == 0)
+	return;
+    printf("%-5s", "Total");
+    printrate(secs * 1e9, ops, 10, 1);
+    printrate(total[CTR_INSTRUCTIONS], ops, 10, 1);
+    printrate(total[CTR_CYCLES], ops, 10, 1);
+    printrate(total[CTR_INSTRUCTIONS] < 0 ? -1 : total[CTR_INSTRUCTIONS],
+	      total[CTR_CYCLES], 7, 2);
+    printrate(total[CTR_L1D_MISSES], ops, 10, 3);
+    printrate(total[CTR_LLC_MISSES], ops, 10, 3);
+    printrate(total[CTR_BRANCH_MISSES], ops, 10, 3);
+    printf("\n");
+}
+
+/*
+ * printrate - print count/per in a field of the given width, or "-"
+ *     if either is unknown (negative)
+ */
+static void printrate(double count, double per, int width, int prec)
+{
+    if (count < 0 || per <= 0)
+	printf("%*s", width, "-");
+    else
+	printf("%*.*f", width, prec, count / per);
+}
+
+/*
+ * lat_add - count a request that took t units in its bucket.  Values
+ *     below LAT_SUB have a bucket each; above that, bucket b covers
+ *     the values with the same highest bit and next LAT_SUB_BITS bits.
+ */
+static void lat_add(latency_t *lat, unsigned long long t)
+{
+    int msb, b;
+
+    if (t < LAT_SUB) {
+	b = t;
+    } else {
+	msb = 63 - __builtin_clzll(t);
+	b = ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+	    ((t >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1));
+    }
+    lat->count[b]++;
+    lat->n++;
+    if (t > lat->max)
+	lat->max = t;
+}
+
+/*
+ * lat_percentile - the latency that a fraction p of the requests do not
+ *     exceed, taken as the top of the bucket that holds it
+ */
+static unsigned long long lat_percentile(latency_t *lat, double p)
+{
+    unsigned long target, seen = 0;
+    unsigned long long top;
+    int b, shift;
+
+    target = (unsigned long)(p * lat->n);
+    if (target < p * lat->n || target == 0)
+	target++;
+    for (b = 0; b < LAT_BUCKETS; b++) {
+	if ((seen += lat->count[b]) >= target)
+	    break;
+    }
+    if (b < LAT_SUB) {
+	top = b;
+    } else {
+	shift = (b >> LAT_SUB_BITS) - 1;
+	top = ((unsigned long long)(LAT_SUB + (b & (LAT_SUB - 1)) + 1)
+	       << shift) - 1;
+    }
+    return (top < lat->max) ? top : lat->max;
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -999,18 +1517,65 @@ void malloc_error(int tracenum, int opnum, char *msg)
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * readn - read n bytes from fd, stopping early only at end of file
+ */
+static ssize_t readn(int fd, void *buf, size_t n)
+{
+    size_t left = n;
+    ssize_t nread;
+    char *bufp = buf;
+
+    while (left > 0) {
+	if ((nread = read(fd, bufp, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (nread == 0)
+	    break;
+	left -= nread;
+	bufp += nread;
+    }
+    return n - left;
+}
+
+/*
+ * writen - write all n bytes of buf to fd
+ */
+static ssize_t writen(int fd, void *buf, size_t n)
+{
+    size_t left = n;
+    ssize_t nwritten;
+    char *bufp = buf;
+
+    while (left > 0) {
+	if ((nwritten = write(fd, bufp, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	left -= nwritten;
+	bufp += nwritten;
+    }
+    return n;
+}
+
 /* 
  * usage - Explain the command line arguments
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValLP] [-f <file>] [-t <dir>] [-j <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate up to <n> traces at once.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Report per-request latency percentiles.\n");
+    fprintf(stderr, "\t-P         Report hardware event counts per request.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
@@ -2,7 +2,22 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The heap lives in a MAX_HEAP range of address space that is
+ *            reserved with mmap but not backed by memory.  Pages are
+ *            committed in MEM_COMMIT_CHUNK steps as the brk grows, and
+ *            mem_trim and mem_release hand pages back to the OS.
+ *
+ *            Large blocks may also live in their own mappings outside
+ *            the heap (mem_mmap, mem_munmap, mem_mremap).  memlib keeps
+ *            a table of them so that the driver can check payloads and
+ *            count them in the footprint.
+ *
+ *            Running out of memory is not an error here: the routines
+ *            just fail with errno set to ENOMEM and leave it to the
+ *            caller (e.g. a malloc that returns NULL) to report.
  */
+#define _GNU_SOURCE /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,24 +29,65 @@
 #include "memlib.h"
 #include "config.h"
 
+/* granularity (bytes) in which reserved pages are made accessible */
+#define MEM_COMMIT_CHUNK (64*(1<<10))
+
+/* 
+ * MADV_FREE lets the kernel reclaim the pages lazily, so a heap that 
+ * grows back over them soon doesn't take a page fault per page. 
+ */
+#ifdef MADV_FREE
+#define MEM_MADV MADV_FREE
+#else
+#define MEM_MADV MADV_DONTNEED
+#endif
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_commit_brk; /* end of the pages made accessible so far */
+static char *mem_high_brk;   /* highest brk so far; still zero above it */
+static size_t mem_peak_size; /* largest footprint since the last reset */
+
+/* mappings made with mem_mmap that are still alive */
+typedef struct {
+    char *addr;
+    size_t size;
+} mapping_t;
+
+static mapping_t *mem_maps;  /* table of live mappings */
+static int mem_nmaps;        /* number of live mappings */
+static int mem_maxmaps;      /* capacity of mem_maps */
+static size_t mem_mapped;    /* total bytes in live mappings */
+
+static void update_peak(void);
+static mapping_t *find_mapping(void *addr);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* calling it again just empties the heap we already reserved */
+    if (mem_start_brk != NULL) {
+	mem_reset_brk();
+	return;
+    }
+
+    /* reserve the address space we will use to model the available VM */
+    mem_start_brk = mmap(NULL, MAX_HEAP, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_commit_brk = mem_start_brk;           /* nothing committed yet */
+    mem_high_brk = mem_start_brk;             /* nothing handed out yet */
+    mem_peak_size = 0;
 }
 
 /* 
@@ -39,35 +95,222 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_reset_brk();
+    munmap(mem_start_brk, MAX_HEAP);
+    mem_start_brk = NULL;
+    if (mem_maps != NULL)
+	munmap(mem_maps, mem_maxmaps * sizeof(mapping_t));
+    mem_maps = NULL;
+    mem_maxmaps = 0;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    Committed pages stay accessible so that repeated runs over the
+ *    same trace don't pay for the page faults again.
  */
 void mem_reset_brk()
 {
+    while (mem_nmaps > 0) {
+	mem_nmaps--;
+	munmap(mem_maps[mem_nmaps].addr, mem_maps[mem_nmaps].size);
+    }
+    mem_mapped = 0;
     mem_brk = mem_start_brk;
+    mem_peak_size = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    In this model, the heap cannot be shrunk with a negative incr;
+ *    use mem_trim for that.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
+    char *commit;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
 	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
+    if (mem_brk + incr > mem_commit_brk) {
+	/* make the next pages accessible, a whole chunk at a time */
+	commit = mem_start_brk + (mem_brk + incr - mem_start_brk + 
+				  MEM_COMMIT_CHUNK - 1) / MEM_COMMIT_CHUNK * 
+	    MEM_COMMIT_CHUNK;
+	if (commit > mem_max_addr)
+	    commit = mem_max_addr;
+	if (mprotect(mem_commit_brk, commit - mem_commit_brk, 
+		     PROT_READ | PROT_WRITE) < 0) {
+	    errno = ENOMEM;
+	    return (void *)-1;
+	}
+	mem_commit_brk = commit;
+    }
     mem_brk += incr;
+    if (mem_brk > mem_high_brk)
+	mem_high_brk = mem_brk;
+    update_peak();
     return (void *)old_brk;
 }
 
+/*
+ * mem_trim - shrink the heap by len bytes and return the whole pages
+ *    above the new brk to the OS.  The pages stay mapped, and their
+ *    contents are undefined if the heap grows over them again.
+ */
+int mem_trim(size_t len)
+{
+    if (len > (size_t)(mem_brk - mem_start_brk)) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_trim failed. Heap is too small...\n");
+	return -1;
+    }
+    mem_brk -= len;
+    mem_release(mem_brk, len);
+    return 0;
+}
+
+/*
+ * mem_release - tell the OS it may reclaim the whole pages inside
+ *    [addr, addr+len).  The allocator calls this for large free blocks
+ *    inside the heap; their contents are undefined afterwards.
+ */
+void mem_release(void *addr, size_t len)
+{
+    size_t pagesize = mem_pagesize();
+    char *lo = (char *)(((unsigned long)addr + pagesize - 1) & ~(pagesize - 1));
+    char *hi = (char *)(((unsigned long)addr + len) & ~(pagesize - 1));
+
+    if (lo < hi)
+	madvise(lo, hi - lo, MEM_MADV);
+}
+
+/*
+ * mem_mmap - map a fresh zero-filled region of size bytes outside the
+ *    heap.  size must be a multiple of the page size.  Returns
+ *    (void *)-1 on failure, like mem_sbrk.
+ */
+void *mem_mmap(size_t size)
+{
+    char *addr;
+    mapping_t *maps;
+    int maxmaps;
+
+    /* 
+     * Grow the table with mmap rather than realloc, so that memlib 
+     * never calls the libc malloc that mm.c may be standing in for 
+     */
+    if (mem_nmaps == mem_maxmaps) {
+	maxmaps = mem_maxmaps ? 2 * mem_maxmaps : 256;
+	maps = mmap(NULL, maxmaps * sizeof(mapping_t), PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (maps == MAP_FAILED)
+	    return (void *)-1;
+	if (mem_maps != NULL) {
+	    memcpy(maps, mem_maps, mem_nmaps * sizeof(mapping_t));
+	    munmap(mem_maps, mem_maxmaps * sizeof(mapping_t));
+	}
+	mem_maps = maps;
+	mem_maxmaps = maxmaps;
+    }
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+	return (void *)-1;
+    mem_maps[mem_nmaps].addr = addr;
+    mem_maps[mem_nmaps].size = size;
+    mem_nmaps++;
+    mem_mapped += size;
+    update_peak();
+    return addr;
+}
+
+/*
+ * mem_munmap - unmap a region returned by mem_mmap or mem_mremap
+ */
+int mem_munmap(void *addr, size_t size)
+{
+    mapping_t *m = find_mapping(addr);
+
+    if (m == NULL || m->size != size) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_munmap failed. No such mapping...\n");
+	return -1;
+    }
+    munmap(addr, size);
+    mem_mapped -= size;
+    *m = mem_maps[--mem_nmaps];
+    return 0;
+}
+
+/*
+ * mem_mremap - resize a region returned by mem_mmap, moving it if
+ *    needed.  The kernel moves the pages, so the contents are never
+ *    copied.  Returns (void *)-1 on failure.
+ */
+void *mem_mremap(void *addr, size_t old_size, size_t new_size)
+{
+    mapping_t *m = find_mapping(addr);
+    char *new_addr;
+
+    if (m == NULL || m->size != old_size) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_mremap failed. No such mapping...\n");
+	return (void *)-1;
+    }
+    new_addr = mremap(addr, old_size, new_size, MREMAP_MAYMOVE);
+    if (new_addr == MAP_FAILED)
+	return (void *)-1;
+    m->addr = new_addr;
+    m->size = new_size;
+    mem_mapped = mem_mapped - old_size + new_size;
+    update_peak();
+    return new_addr;
+}
+
+/*
+ * mem_is_mapped - return true if [lo, hi] lies inside one mapping
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    int i;
+
+    for (i = 0; i < mem_nmaps; i++) {
+	if ((char *)lo >= mem_maps[i].addr && 
+	    (char *)hi < mem_maps[i].addr + mem_maps[i].size)
+	    return 1;
+    }
+    return 0;
+}
+
+/*
+ * find_mapping - return the table entry of the mapping starting at addr
+ */
+static mapping_t *find_mapping(void *addr)
+{
+    int i;
+
+    for (i = 0; i < mem_nmaps; i++) {
+	if (mem_maps[i].addr == addr)
+	    return &mem_maps[i];
+    }
+    return NULL;
+}
+
+/*
+ * update_peak - remember the footprint if it is the largest so far
+ */
+static void update_peak(void)
+{
+    size_t size = (size_t)(mem_brk - mem_start_brk) + mem_mapped;
+
+    if (size > mem_peak_size)
+	mem_peak_size = size;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +327,16 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_heap_fresh - return the first heap byte that mem_sbrk has never
+ *    handed out.  Resetting or trimming the heap doesn't lower it, so 
+ *    the heap is still zero-filled from there up.
+ */
+void *mem_heap_fresh()
+{
+    return (void *)mem_high_brk;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
@@ -92,6 +345,17 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest footprint in bytes since
+ *    the last mem_reset_brk, counting both the heap and the regions
+ *    from mem_mmap.  This differs from mem_heapsize() once the
+ *    allocator has trimmed the heap or unmapped a region.
+ */
+size_t mem_peak_heapsize() 
+{
+    return mem_peak_size;
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
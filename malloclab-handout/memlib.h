@@ -3,9 +3,17 @@
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+int mem_trim(size_t len);
+void mem_release(void *addr, size_t len);
+void *mem_mmap(size_t size);
+int mem_munmap(void *addr, size_t size);
+void *mem_mremap(void *addr, size_t old_size, size_t new_size);
+int mem_is_mapped(void *lo, void *hi);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_fresh(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
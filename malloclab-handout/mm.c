@@ -10,7 +10,10 @@
  * comment that gives a high level description of your solution.
  */
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +22,12 @@
 #include "memlib.h"
 #include "mm.h"
 
+#include "config.h"
+
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
+
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in the following struct.
@@ -57,6 +66,19 @@ team_t team = {
 // 从头部或脚部获得块大小和已分配位
 #define GET_SIZE(p) (*(unsigned int *)(p) & ~0x7)
 #define GET_ALLOC(p) (*(unsigned int *)(p)&0x1)
+// 头部的第 1 位记录前一个块是否已分配，这样已分配块就不需要脚部了，
+// 只有空闲块才有脚部
+#define PREV_ALLOC 0x2
+#define GET_PREV_ALLOC(p) (*(unsigned int *)(p)&PREV_ALLOC)
+// 设置或清除 bp 的下一个块头部中的 PREV_ALLOC 位
+#define SET_PREV_ALLOC(bp)                                                     \
+  PUT(HDRP(NEXT_BLKP(bp)), GET(HDRP(NEXT_BLKP(bp))) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(bp)                                                     \
+  PUT(HDRP(NEXT_BLKP(bp)), GET(HDRP(NEXT_BLKP(bp))) & ~PREV_ALLOC)
+// 有效载荷为 size 时需要的块大小：加上头部后按双字对齐，最小块为 16 字节
+#define ASIZE(size)                                                            \
+  ((size) <= DSIZE + WSIZE ? 2 * DSIZE                                         \
+                           : DSIZE * (((size) + WSIZE + (DSIZE - 1)) / DSIZE))
 // 获得块的头部和脚部
 #define HDRP(bp) ((char *)bp - WSIZE)
 #define FTRP(bp) ((char *)bp + GET_SIZE(HDRP(bp)) - DSIZE)
@@ -67,18 +89,235 @@ team_t team = {
 // 获得块中记录的前驱和后继
 #define PRED(bp) ((char *)(bp) + WSIZE)
 #define SUCC(bp) ((char *)(bp))
+// 链接中保存的是块相对于堆起始地址 heap_lo 的 32 位偏移，这样在 64 位下块也不会变大。
+// NONE_BLKP 表示没有前驱或后继，对应的指针是 NULL
+#define NONE_BLKP (unsigned int)-1
+#define TO_OFFSET(bp) ((unsigned int)((char *)(bp) - heap_lo))
+#define TO_BLKP(off) ((off) == NONE_BLKP ? NULL : (void *)(heap_lo + (off)))
+#define GET_BLKP(p) TO_BLKP(GET(p))
+#define PUT_BLKP(p, bp) PUT(p, (bp) == NULL ? NONE_BLKP : TO_OFFSET(bp))
 // 获取前驱和后继的地址
-#define PRED_BLKP(bp) (GET(PRED(bp)))
-#define SUCC_BLKP(bp) (GET(SUCC(bp)))
+#define PRED_BLKP(bp) GET_BLKP(PRED(bp))
+#define SUCC_BLKP(bp) GET_BLKP(SUCC(bp))
+
+// 空闲块的组织方式：为 1 时按地址排序，每个大小类是一棵以块地址为键的 treap，
+// 前驱和后继字段分别用作左右孩子，插入和删除都是 O(log n)；为 0 时是 LIFO 双向链表
+#ifndef ADDRESS_ORDER
+#define ADDRESS_ORDER 1
+#endif
+#define LEFT(bp) PRED(bp)
+#define RIGHT(bp) SUCC(bp)
+// 最后一个大小类 {4096-inf} 不论哪种方式都是一棵以 (大小, 地址) 为键的 treap，
+// 这样大块可以在 O(log n) 时间内做最佳适配
+#define LARGE_CLASS (NUM_CLASSES - 1)
+#define TREE_CLASS(index) (ADDRESS_ORDER || (index) == LARGE_CLASS)
+
+// 放置策略：FIT_POLICY 为 0 时首次适配（大小类中第一个放得下的块），为 1 时最佳适配
+// （放得下的最小块）。大块所在的最后一个大小类总是最佳适配
+#ifndef FIT_POLICY
+#define FIT_POLICY 0
+#endif
+#define FIT(asize) (FIT_POLICY ? best_fit(asize) : first_fit(asize))
+// 分割策略：剩余部分至少有 SPLIT_THRESHOLD 字节才分割出一个空闲块，否则整块分配出去，
+// 最小是一个最小块的大小
+#ifndef SPLIT_THRESHOLD
+#define SPLIT_THRESHOLD (2 * DSIZE)
+#endif
+// 分割时小于 SMALL_PLACE 的块从空闲块的高地址一端切出，为 0 时总是从低地址一端切出
+#ifndef SMALL_PLACE
+#define SMALL_PLACE 128
+#endif
 
-#define NONE_BLKP (unsigned int)-1 // 表示没有前驱或后继
+// 大小类的个数，以及记录哪些大小类非空的位图（放在根表之后）
+#define NUM_CLASSES 31
+_Static_assert(NUM_CLASSES == MM_STATS_CLASSES, "mm_stats_t 的大小类个数不一致");
+#define BITMAP(root) ((root) + NUM_CLASSES * WSIZE)
+// arena 头部占用的字数：根表、位图、slab 链表的根、一个填充字、序言块和结尾块
+#define ARENA_WORDS (NUM_CLASSES + SLAB_CLASSES + 5)
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+// 堆按 HEAP_PAGE_SIZE 分页（相对于 mem_heap_lo() 计算），page_map 记录每页的信息：
+// 低 7 位是这一页所属的 arena，最高位表示这一页是 slab 页
+#define HEAP_PAGE_SHIFT 12
+#define HEAP_PAGE_SIZE (1 << HEAP_PAGE_SHIFT)
+#define PAGE_SLAB 0x80
+#define PAGE_INDEX(p) (((char *)(p) - heap_lo) >> HEAP_PAGE_SHIFT)
+#define IN_HEAP(p) ((size_t)((char *)(p) - heap_lo) < MAX_HEAP)
+#define IS_SLAB(p) (IN_HEAP(p) && (page_map[PAGE_INDEX(p)] & PAGE_SLAB))
+
+// 有效载荷不小于 MMAP_THRESHOLD 的请求单独用 mem_mmap 映射一块区域，释放时直接
+// 解除映射，不在堆中留下碎片。头部的第 2 位标记这种块。整个区域的大小可能超过
+// 4 GB，头部放不下，所以存在头部前面第二个双字里（size_t）；头部前面一个字是它
+// 相对区域开头的偏移减去一个字
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (128 * 1024)
+#endif
+#define MMAPPED 0x4
+#define IS_MMAPPED(bp) (GET(HDRP(bp)) & MMAPPED)
+#define MMAP_START(bp) ((char *)(bp) - DSIZE - GET((char *)(bp) - DSIZE))
+#define MMAP_SIZE(bp) (*(size_t *)((char *)(bp) - 2 * DSIZE))
+
+// 堆末尾的空闲块超过 arena 的 trim_threshold 时只留下大约 TRIM_PAD，其余的页还给
+// memlib。还回去的空间很快又被重新申请时说明收缩得太积极了，阈值翻倍，最大到
+// MAX_TRIM_THRESHOLD。堆中间合并出的空闲块超过 RELEASE_THRESHOLD 时，
+// 其中整页的物理内存还给操作系统
+#define TRIM_THRESHOLD (128 * 1024)
+#define MAX_TRIM_THRESHOLD (32 * 1024 * 1024)
+#define TRIM_PAD (64 * 1024)
+#define RELEASE_THRESHOLD (64 * 1024)
+
+// slab 层：有效载荷不超过 SLAB_MAX 的请求按 8 字节分成 SLAB_CLASSES 类，从 slab
+// 页中分配。slab 页与 HEAP_PAGE_SIZE 对齐，开头是描述符 slab_t，其余切成大小相同的
+// 槽，槽没有头部，释放时通过 page_map 找到所在的 slab 页
+#ifndef USE_SLAB
+#define USE_SLAB 1
+#endif
+#define SLAB_MAX 64
+#define SLAB_CLASSES (SLAB_MAX / DSIZE)
+#define SLAB_INDEX(size) (((size) + DSIZE - 1) / DSIZE - 1)
+#define SLAB_SIZE(size) (DSIZE * (SLAB_INDEX(size) + 1)) // 槽的大小
+#define SLAB_MAP_WORDS (HEAP_PAGE_SIZE / DSIZE / 32)
+#define SLAB_HDR ALIGN(sizeof(slab_t))
+#define SLAB_OF(p) ((slab_t *)(heap_lo + (PAGE_INDEX(p) << HEAP_PAGE_SHIFT)))
+#define SLAB_ROOT(root, index) ((root) + (NUM_CLASSES + 1 + (index)) * WSIZE)
+
+typedef struct {
+  unsigned int next; // 同一大小类中还有空闲槽的 slab 串成双向链表
+  unsigned int prev;
+  unsigned short size;   // 槽的大小
+  unsigned short nslots; // 槽的个数
+  unsigned short nfree;  // 空闲槽的个数
+  unsigned int map[SLAB_MAP_WORDS]; // 空闲槽位图，1 表示空闲
+} slab_t;
+
+// 多 arena 模式（编译时定义 MM_THREADS 打开）：每个线程绑定 NARENAS 个 arena
+// 中的一个，每个 arena 有自己的空闲链表根表和锁，分配和释放只锁块所在的 arena；
+// 另外每个线程有一个 tcache，缓存最近释放的小块，命中时完全不用加锁
+#ifdef MM_THREADS
+#ifndef NARENAS
+#define NARENAS 8
+#endif
+#define THREAD_LOCAL __thread
+// arena 每次向 mem_sbrk 申请的空间都按页对齐，这样通过块所在的页号就能找到 arena
+#define PAGE_ALIGN(size) (((size) + HEAP_PAGE_SIZE - 1) & ~(HEAP_PAGE_SIZE - 1))
+#define PAGE_ARENA 0x7f
+// tcache 按块大小分桶（16~256，步长 8），每个桶最多缓存 TCACHE_COUNT 个块
+#define TCACHE_MAX 256
+#define TCACHE_BINS (TCACHE_MAX / DSIZE - 1)
+#define TCACHE_COUNT 7
+#define TCACHE_INDEX(size) ((size) / DSIZE - 2)
+#else
+#define NARENAS 1
+#define THREAD_LOCAL
+#endif
+
+// realloc 记录最近扩大过的块，同一个块反复扩大时按当前大小的一定比例多留出空间，
+// 下次扩大就不用再移动
+#define GROW_SLOTS 8
+#define GROW_SLOT(bp) ((TO_OFFSET(bp) >> 3) % GROW_SLOTS)
+#define GROW_HEADROOM(asize, count) ((count) < 2 ? 0 : (asize) >> 1)
+
+typedef struct {
+  void *bp;
+  unsigned int count; // 连续扩大的次数
+} grow_t;
+
+// 延迟合并（DEFER_COALESCE 为 1 时打开）：不超过 QUICK_MAX 的块释放时不合并，
+// 仍标记为已分配，按大小放进 arena 的快速链表（LIFO 单链表，链接放在有效载荷开头），
+// 下次同样大小的请求直接取走。只有空闲链表中找不到合适的块时，才把快速链表中的
+// 块全部真正释放并合并（delay_coalesce）
+#ifndef DEFER_COALESCE
+#define DEFER_COALESCE 1
+#endif
+#define QUICK_MAX 256
+#define QUICK_BINS (QUICK_MAX / DSIZE - 1)
+#define QUICK_INDEX(size) ((size) / DSIZE - 2)
+
+// mm_malloc_batch 一次从一个空闲块中切出多个块，一次最多切 BATCH_BYTES 字节
+#define BATCH_BYTES (64 * CHUNKSIZE)
+
+// mm_stats 用到的计数，每个 arena 在自己的锁内累加，mm_stats 时再汇总
+typedef struct {
+  size_t sbrk_calls, sbrk_bytes;
+  size_t coalesces, splits, realloc_inplace;
+} counter_t;
+#define COUNT(field, n) (cur_arena->count.field += (n))
+
+typedef struct {
+#ifdef MM_THREADS
+  pthread_mutex_t lock;
+#endif
+  char *listp;    // 空闲链表根表，位于堆中
+  char *epilogue; // 当前结尾块的头部，用于判断新申请的空间是否与之相连
+  grow_t grow[GROW_SLOTS];
+  size_t trim_threshold;
+  char *trim_mark; // 上次收缩之前的堆末尾
+  void *quick[QUICK_BINS]; // 快速链表
+  int quick_count;         // 快速链表中块的总数
+  counter_t count;
+
+} arena_t;
+
+static arena_t arenas[NARENAS];
+static THREAD_LOCAL arena_t *cur_arena; // 当前正在操作的 arena
+// 当前线程最近一次从 mem_sbrk 得到的空间中从没用过（还是 0）的部分
+static THREAD_LOCAL char *fresh_lo, *fresh_hi;
 
 static char *heap_listp;
-static char *listp;
+static THREAD_LOCAL char *listp; // 即 cur_arena->listp
+static char *heap_lo;            // mem_heap_lo()
+static unsigned char page_map[MAX_HEAP >> HEAP_PAGE_SHIFT];
+
+#ifdef MM_THREADS
+typedef struct {
+  void *head[TCACHE_BINS]; // 块仍标记为已分配，用有效载荷的开头串成单链表
+  int count[TCACHE_BINS];
+  arena_t *arena; // 线程绑定的 arena
+  int generation; // 与 mm_generation 不同说明堆已被 mm_init 重置
+} tcache_t;
 
+static int mm_generation;
+static unsigned int next_arena; // 轮流给新线程分配 arena
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mm_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+static THREAD_LOCAL tcache_t tcache;
+
+static void mm_once_init(void);
+static arena_t *thread_arena(void);
+static arena_t *arena_of(void *bp);
+static int arena_enter(arena_t *a);
+static void arena_leave(void);
+static void *tcache_get(size_t asize);
+static int tcache_put(void *bp);
+static void tcache_flush(void *arg);
+#endif
+
+static void arena_init(arena_t *a, char *p);
+static void *heap_sbrk(size_t size);
+static int heap_unsbrk(char *end, size_t size);
+static void heap_trim(void *bp);
+static void *init_chunk(char *p, size_t size);
 static void *expend_heap(size_t words);
+static void *malloc_block(size_t asize);
+static void *mmap_block(size_t size, size_t align);
+static void *mmap_resize(void *bp, size_t size);
+static void mmap_free(void *bp);
+static void *aligned_block(size_t align, size_t asize);
+static void free_block(void *bp);
+static int quick_put(void *bp);
+static void shrink_block(void *bp, size_t asize);
+static int extend_tail(void *bp, size_t asize);
+static size_t carve_blocks(size_t asize, size_t n, void **ptrs);
+static int ptr_cmp(const void *a, const void *b);
+
+static void *slab_alloc(size_t size);
+static void slab_free(void *ptr);
+static slab_t *slab_new(char *root, size_t slot);
+static void slab_link(char *root, slab_t *slab);
+static void slab_unlink(char *root, slab_t *slab);
 
 // 立即合并
 static void *imme_coalesce(void *bp);
@@ -99,21 +338,45 @@ static int get_index_by_size(size_t size);
 
 // LIFO 策略
 static void *LIFO(void *bp, void *root);
-// 地址顺序策略
-static void *address_order(void *bp, void *root);
+// 地址顺序策略，以及大块的按大小排序
+static void *tree_insert(void *root, void *bp, int by_size);
+static void tree_delete(void *root, void *bp, int by_size);
+static void *tree_first_fit(void *node, size_t asize);
+static void *tree_best_fit(void *node, size_t asize);
+static void *class_best_fit(void *node, size_t asize, void *best);
+static int key_less(void *a, void *b, int by_size);
+static unsigned int priority(void *bp);
 
-static void place(void *bp, size_t asize);
+static void *place(void *bp, size_t asize);
+
+static void stats_free(mm_stats_t *st, int index, void *node);
+static void stats_cached(mm_stats_t *st, void *bp);
+static void stats_block(mm_stats_t *st, int index, size_t size);
 
 static void debug(char *msg) {
   printf("\n%s\n", msg);
   fflush(stdout);
 }
 
+static void print_tree(void *node){
+	if(node==NULL)
+		return;
+	print_tree(GET_BLKP(LEFT(node)));
+	printf("-->%p,%d",node, GET_SIZE(HDRP(node)));
+	print_tree(GET_BLKP(RIGHT(node)));
+}
+
 static void print_listp(){
 	int ind;
 	void *node, *root;
 	printf("print listp\n");
-	for(ind=1;ind<=8;ind++){
+	for(ind=0;ind<NUM_CLASSES;ind++){
+		if(TREE_CLASS(ind)){
+			printf("%d:\n",ind);
+			print_tree(GET_BLKP(listp+ind*WSIZE));
+			printf("\n");
+			continue;
+		}
 		node = listp+ind*WSIZE;
 		root = listp+ind*WSIZE;
 		printf("%d:\n",ind);
@@ -132,39 +395,84 @@ static void print_listp(){
 }
 
 // 注: 大小类设计为
-// {16-31},{32-63},{64-127},{128-255},{256-511},{512-1023},{1024-2047},{2048-4095},{4096-inf}
+// 小于 64 的块每 8 字节一类: {16},{24},{32},{40},{48},{56}
+// 64~4095 每个 2 的幂区间再均分为 4 类: {64-79},{80-95},{96-111},{112-127},
+// {128-159},...,{3584-4095}
+// 最后一类为 {4096-inf}
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void) {
   mem_init();
-  if ((heap_listp = mem_sbrk(12 * WSIZE)) == (void *)-1) { // 申请12字空间
+  heap_lo = mem_heap_lo();
+  memset(page_map, 0, sizeof(page_map));
+  for (int i = 0; i < NARENAS; ++i) {
+    memset(&arenas[i].count, 0, sizeof(counter_t));
+  }
+  cur_arena = &arenas[0];
+#ifdef MM_THREADS
+  // 重置所有 arena，调用线程绑定到 0 号 arena；其他 arena 在第一次使用时才创建
+  pthread_once(&mm_once, mm_once_init);
+  for (int i = 0; i < NARENAS; ++i) {
+    arenas[i].listp = NULL;
+  }
+  ++mm_generation;
+  next_arena = 1;
+  memset(&tcache, 0, sizeof(tcache));
+  tcache.generation = mm_generation;
+  tcache.arena = cur_arena;
+  pthread_setspecific(tcache_key, &tcache);
+
+  // 0 号 arena 的根表和第一个空闲块放在同一页中
+  if ((heap_listp = heap_sbrk(CHUNKSIZE)) == (void *)-1) {
     return -1;
   }
+  arena_init(cur_arena, heap_listp);
+  heap_listp += (ARENA_WORDS - 2) * WSIZE;
+  if (init_chunk(heap_listp + 2 * WSIZE, CHUNKSIZE - ARENA_WORDS * WSIZE) ==
+      NULL) {
+    return -1;
+  }
+#else
+  if ((heap_listp = mem_sbrk(ARENA_WORDS * WSIZE)) == (void *)-1) {
+    return -1;
+  }
+  arena_init(cur_arena, heap_listp);
+  heap_listp += (ARENA_WORDS - 2) * WSIZE; // 指向序言块有效载荷的指针
+  if (expend_heap(CHUNKSIZE / WSIZE) == NULL) {
+    return -1;
+  }
+#endif
+  return 0;
+}
 
+/*
+ * arena_init - 在 p 开始的 ARENA_WORDS 字中放置空闲链表根表、非空大小类位图、
+ *     序言块和结尾块
+ */
+static void arena_init(arena_t *a, char *p) {
   // 因为最小块包含了头部、脚部、前驱和后继，所以最小块大小为16字节（4字）
   // 赋值为 -1，即 unsigned int 的最大值
-  PUT(heap_listp + 0 * WSIZE, NONE_BLKP); // {16-31}
-  PUT(heap_listp + 1 * WSIZE, NONE_BLKP); // {32-63}
-  PUT(heap_listp + 2 * WSIZE, NONE_BLKP); // {64-127}
-  PUT(heap_listp + 3 * WSIZE, NONE_BLKP); // {128-255}
-  PUT(heap_listp + 4 * WSIZE, NONE_BLKP); // {256-511}
-  PUT(heap_listp + 5 * WSIZE, NONE_BLKP); // {512-1023}
-  PUT(heap_listp + 6 * WSIZE, NONE_BLKP); // {1024-2047}
-  PUT(heap_listp + 7 * WSIZE, NONE_BLKP); // {2048-4095}
-  PUT(heap_listp + 8 * WSIZE, NONE_BLKP); // {4096-inf}
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    PUT(p + i * WSIZE, NONE_BLKP);
+  }
+  PUT(BITMAP(p), 0); // 一开始所有大小类都是空的
+  memset(a->grow, 0, sizeof(a->grow));
+  memset(a->quick, 0, sizeof(a->quick));
+  a->quick_count = 0;
+  a->trim_threshold = TRIM_THRESHOLD;
+  a->trim_mark = NULL;
+  for (int i = 0; i < SLAB_CLASSES; ++i) {
+    PUT(SLAB_ROOT(p, i), NONE_BLKP);
+  }
 
   // 序言块和结尾块
-  PUT(heap_listp + 9 * WSIZE, PACK(DSIZE, 1));
-  PUT(heap_listp + 10 * WSIZE, PACK(DSIZE, 1));
-  PUT(heap_listp + 11 * WSIZE, PACK(0, 1));
+  PUT(p + (ARENA_WORDS - 3) * WSIZE, PACK(DSIZE, 1));
+  PUT(p + (ARENA_WORDS - 2) * WSIZE, PACK(DSIZE, 1));
+  PUT(p + (ARENA_WORDS - 1) * WSIZE, PACK(0, PREV_ALLOC | 1));
 
-  listp = heap_listp;
-  heap_listp += 10 * WSIZE; // 指向序言块有效载荷的指针
-  if (expend_heap(CHUNKSIZE / WSIZE) == NULL) {
-    return -1;
-  }
-  return 0;
+  a->listp = listp = p;
+  a->epilogue = p + (ARENA_WORDS - 1) * WSIZE;
 }
 
 /*
@@ -176,51 +484,445 @@ void *mm_malloc(size_t size) {
     return NULL;
   }
   // 满足最小块要求和对齐要求，size是有效负荷大小
-  size_t asize = size <= DSIZE
-                     ? (2 * DSIZE)
-                     : DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+  size_t asize = ASIZE(size);
   void *bp;
-  // 首次匹配
-  // if ((bp = first_fit(asize)) != NULL) {
-  //   place(bp, asize);
-  //   return bp;
-  // }
-
-  // 最佳适配
-  if ((bp = first_fit(asize)) != NULL) {
-    place(bp, asize);
+  if (size >= MMAP_THRESHOLD) {
+    return mmap_block(size, DSIZE);
+  }
+#ifdef MM_THREADS
+  arena_t *a = thread_arena();
+  if ((!USE_SLAB || size > SLAB_MAX) && (bp = tcache_get(asize)) != NULL) {
     return bp;
   }
+  if (arena_enter(a) < 0) {
+    return NULL;
+  }
+#endif
+  if (USE_SLAB && size <= SLAB_MAX) {
+    bp = slab_alloc(size);
+  } else {
+    bp = malloc_block(asize);
+  }
+#ifdef MM_THREADS
+  arena_leave();
+#endif
+  return bp;
+}
+
+/*
+ * mm_memalign - 分配有效载荷为 size、地址是 align 的倍数的块，align 必须是 2 的幂
+ */
+void *mm_memalign(size_t align, size_t size) {
+  void *bp;
+  if (align & (align - 1)) {
+    return NULL;
+  }
+  if (align <= ALIGNMENT) {
+    return mm_malloc(size);
+  }
+  if (size == 0) {
+    return NULL;
+  }
+  if (size >= MMAP_THRESHOLD) {
+    return mmap_block(size, align);
+  }
+#ifdef MM_THREADS
+  if (arena_enter(thread_arena()) < 0) {
+    return NULL;
+  }
+#endif
+  bp = aligned_block(align, ASIZE(size));
+#ifdef MM_THREADS
+  arena_leave();
+#endif
+  return bp;
+}
 
-  // 否则扩堆
-  if ((bp = expend_heap(MAX(CHUNKSIZE, asize) / WSIZE)) == NULL) {
+/*
+ * mm_calloc - 分配 nmemb 个 size 字节的元素并清零。映射的块，以及这次调用中才从
+ *     mem_sbrk 得到、以前从没用过的空间本来就是 0，只需要清掉分配器自己写过的
+ *     链接和脚部
+ */
+void *mm_calloc(size_t nmemb, size_t size) {
+  size_t total = nmemb * size, usable, lo;
+  char *bp;
+  if (size != 0 && total / size != nmemb) { // 溢出
     return NULL;
   }
-  place(bp, asize);
+  fresh_lo = fresh_hi = NULL;
+  if ((bp = mm_malloc(total)) == NULL) {
+    return NULL;
+  }
+  if (!IS_SLAB(bp) && IS_MMAPPED(bp)) {
+    return bp;
+  }
+  if (bp < fresh_lo || bp + total > fresh_hi) {
+    memset(bp, 0, total);
+  } else if (!IS_SLAB(bp)) {
+    // 块切自一个新的空闲块，只有开头的链接和末尾的脚部被写过
+    usable = GET_SIZE(HDRP(bp)) - WSIZE;
+    memset(bp, 0, MIN(total, DSIZE));
+    lo = MAX(DSIZE, usable - DSIZE);
+    if (total > lo) {
+      memset(bp + lo, 0, total - lo);
+    }
+  }
   return bp;
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_usable_size - ptr 指向的块实际能用的有效载荷字节数：slab 中按槽的大小，
+ *     映射的块到映射末尾为止，普通的块是块大小减去头部
+ */
+size_t mm_usable_size(void *ptr) {
+  if (IS_SLAB(ptr)) {
+    return SLAB_OF(ptr)->size;
+  }
+  if (IS_MMAPPED(ptr)) {
+    return MMAP_START(ptr) + MMAP_SIZE(ptr) - (char *)ptr;
+  }
+  return GET_SIZE(HDRP(ptr)) - WSIZE;
+}
+
+/*
+ * malloc_block - 从空闲链表中找一个大小为 asize 的块，找不到就扩堆
+ */
+static void *malloc_block(size_t asize) {
+  void *bp;
+  int index = QUICK_INDEX(asize);
+  // 快速链表中有同样大小的块就直接用
+  if (asize <= QUICK_MAX && (bp = cur_arena->quick[index]) != NULL) {
+    cur_arena->quick[index] = SUCC_BLKP(bp);
+    --cur_arena->quick_count;
+    return bp;
+  }
+  if ((bp = FIT(asize)) == NULL && cur_arena->quick_count > 0) {
+    // 找不到时先把延迟的块合并了再找一次
+    delay_coalesce();
+    bp = FIT(asize);
+  }
+  if (bp != NULL) {
+    bp = place(bp, asize);
+  } else if ((bp = expend_heap(MAX(CHUNKSIZE, asize) / WSIZE)) != NULL) {
+    // 否则扩堆
+    bp = place(bp, asize);
+  }
+  return bp;
+}
+
+/*
+ * aligned_block - 分配一个大小为 asize、有效载荷按 align 对齐的块。多申请 align
+ *     和一个最小块，对齐之前的部分切出来释放，多出的尾部由 shrink_block 切掉，
+ *     所以浪费的空间不超过一个最小块
+ */
+static void *aligned_block(size_t align, size_t asize) {
+  char *bp, *abp;
+  size_t offset;
+  if ((bp = malloc_block(asize + align + 2 * DSIZE)) == NULL) {
+    return NULL;
+  }
+  offset = (size_t)bp & (align - 1);
+  abp = offset ? bp + align - offset : bp;
+  if (abp != bp && abp - bp < 2 * DSIZE) { // 前面的碎片放不下一个最小块
+    abp += align;
+  }
+  if (abp != bp) {
+    PUT(HDRP(abp), PACK(GET_SIZE(HDRP(bp)) - (abp - bp), PREV_ALLOC | 1));
+    PUT(HDRP(bp), PACK(abp - bp, GET_PREV_ALLOC(HDRP(bp)) | 1));
+    free_block(bp);
+  }
+  shrink_block(abp, asize);
+  return abp;
+}
+
+/*
+ * mmap_block - 为有效载荷 size 单独映射一块区域，有效载荷按 align 对齐
+ */
+static void *mmap_block(size_t size, size_t align) {
+  size_t page = mem_pagesize();
+  size_t msize = (size + MAX(align, DSIZE) + DSIZE + page - 1) & ~(page - 1);
+  char *p, *bp;
+  if (msize < size) { // 溢出
+    return NULL;
+  }
+#ifdef MM_THREADS
+  pthread_mutex_lock(&sbrk_lock); // memlib 不是线程安全的
+#endif
+  p = mem_mmap(msize);
+#ifdef MM_THREADS
+  pthread_mutex_unlock(&sbrk_lock);
+#endif
+  if (p == (void *)-1) {
+    return NULL;
+  }
+  bp = (char *)(((size_t)p + 2 * DSIZE + align - 1) & ~(align - 1));
+  MMAP_SIZE(bp) = msize;
+  PUT(bp - DSIZE, bp - DSIZE - p);
+  PUT(HDRP(bp), PACK(0, MMAPPED | 1));
+  return bp;
+}
+
+/*
+ * mmap_resize - 用 mem_mremap 把映射的块调整到能放下有效载荷 size，内容不需要复制
+ */
+static void *mmap_resize(void *bp, size_t size) {
+  size_t page = mem_pagesize();
+  size_t old_size = MMAP_SIZE(bp);
+  size_t offset = GET((char *)bp - DSIZE);
+  size_t msize = (size + offset + DSIZE + page - 1) & ~(page - 1);
+  char *p;
+  if (msize < size) {
+    return NULL;
+  }
+  if (msize == old_size) {
+    return bp;
+  }
+#ifdef MM_THREADS
+  pthread_mutex_lock(&sbrk_lock);
+#endif
+  p = mem_mremap(MMAP_START(bp), old_size, msize);
+#ifdef MM_THREADS
+  pthread_mutex_unlock(&sbrk_lock);
+#endif
+  if (p == (void *)-1) {
+    return NULL;
+  }
+  p += offset + DSIZE;
+  MMAP_SIZE(p) = msize;
+  return p;
+}
+
+static void mmap_free(void *bp) {
+#ifdef MM_THREADS
+  pthread_mutex_lock(&sbrk_lock);
+#endif
+  mem_munmap(MMAP_START(bp), MMAP_SIZE(bp));
+#ifdef MM_THREADS
+  pthread_mutex_unlock(&sbrk_lock);
+#endif
+}
+
+/*
+ * mm_free - 释放 slab 中的槽、映射的块或普通的块
  */
 void mm_free(void *ptr) {
-  size_t size = GET_SIZE(HDRP(ptr));
-  PUT(HDRP(ptr), PACK(size, 0));
-  PUT(FTRP(ptr), PACK(size, 0));
+  if (!IS_SLAB(ptr) && IS_MMAPPED(ptr)) {
+    mmap_free(ptr);
+    return;
+  }
+#ifdef MM_THREADS
+  if (!IS_SLAB(ptr) && tcache_put(ptr)) {
+    return;
+  }
+  arena_enter(arena_of(ptr));
+#endif
+  if (IS_SLAB(ptr)) {
+    slab_free(ptr);
+  } else if (!quick_put(ptr)) {
+    free_block(ptr);
+  }
+#ifdef MM_THREADS
+  arena_leave();
+#endif
+}
 
-  // 立即合并
-  ptr = imme_coalesce(ptr);
-  add_block(ptr);
+/*
+ * quick_put - 延迟合并时把小块放进快速链表，放不进去返回 0
+ */
+static int quick_put(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  int index = QUICK_INDEX(size);
+  if (!DEFER_COALESCE || size > QUICK_MAX) {
+    return 0;
+  }
+  PUT_BLKP(SUCC(bp), cur_arena->quick[index]);
+  cur_arena->quick[index] = bp;
+  ++cur_arena->quick_count;
+  return 1;
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * mm_malloc_batch - 分配 n 个有效载荷为 size 的块，指针依次放进 ptrs，返回分配到的
+ *     个数。大小类只查一次：先取快速链表中同样大小的块，剩下的从一个足够大的空闲块
+ *     中一次切出来
  */
-void *mm_realloc(void *ptr, size_t size) {
-  size_t asize, new_bp_size;
-  void *new_bp;
+size_t mm_malloc_batch(size_t size, size_t n, void **ptrs) {
+  size_t asize = ASIZE(size), done = 0, count;
+  int index = QUICK_INDEX(asize);
+  void *bp;
+  if (size == 0) {
+    return 0;
+  }
+  if (size >= MMAP_THRESHOLD) {
+    while (done < n && (ptrs[done] = mmap_block(size, DSIZE)) != NULL) {
+      ++done;
+    }
+    return done;
+  }
+#ifdef MM_THREADS
+  if (arena_enter(thread_arena()) < 0) {
+    return 0;
+  }
+#endif
+  if (USE_SLAB && size <= SLAB_MAX) {
+    while (done < n && (ptrs[done] = slab_alloc(size)) != NULL) {
+      ++done;
+    }
+  } else {
+    while (asize <= QUICK_MAX && done < n &&
+           (bp = cur_arena->quick[index]) != NULL) {
+      cur_arena->quick[index] = SUCC_BLKP(bp);
+      --cur_arena->quick_count;
+      ptrs[done++] = bp;
+    }
+    while (done < n &&
+           (count = carve_blocks(asize, n - done, ptrs + done)) > 0) {
+      done += count;
+    }
+  }
+#ifdef MM_THREADS
+  arena_leave();
+#endif
+  return done;
+}
+
+/*
+ * carve_blocks - 找一个能放下 n 个大小为 asize 的块的空闲块，按顺序切开，最后一个
+ *     块带上分割剩下的零头。放不下就减半再找；和 mm_malloc 一样，一个块都放不下时
+ *     才合并快速链表中的块，还不行再按整批的大小扩堆。返回切出的块数
+ */
+static size_t carve_blocks(size_t asize, size_t n, void **ptrs) {
+  size_t want, total, prev_alloc;
+  char *bp, *end;
+  want = n = MIN(n, MAX(BATCH_BYTES / asize, 1));
+  while ((bp = FIT(n * asize)) == NULL && n > 1) {
+    n /= 2;
+  }
+  if (bp == NULL && cur_arena->quick_count > 0) {
+    delay_coalesce();
+    n = want;
+    while ((bp = FIT(n * asize)) == NULL && n > 1) {
+      n /= 2;
+    }
+  }
+  if (bp == NULL) {
+    if ((bp = expend_heap(MAX(CHUNKSIZE, want * asize) / WSIZE)) == NULL) {
+      return 0;
+    }
+    n = MIN(want, GET_SIZE(HDRP(bp)) / asize);
+  }
+  total = n * asize;
+  bp = place(bp, total);
+  end = NEXT_BLKP(bp);
+  prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+  for (size_t i = 0; i < n - 1; ++i) {
+    PUT(HDRP(bp), PACK(asize, prev_alloc | 1));
+    prev_alloc = PREV_ALLOC;
+    ptrs[i] = bp;
+    bp += asize;
+  }
+  PUT(HDRP(bp), PACK(end - bp, prev_alloc | 1));
+  ptrs[n - 1] = bp;
+  COUNT(splits, n - 1);
+  return n;
+}
+
+/*
+ * mm_free_batch - 释放 ptrs 中的 n 个块，NULL 忽略。slab 中的槽、映射的块和能放进
+ *     快速链表的小块直接释放，不用排序；剩下的大块挪到 ptrs 前面按地址排序，地址上
+ *     紧挨着的块先拼成一个块，整体只释放、合并一次。同一个 arena 的块只加一次锁
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+  size_t i, j, m = 0;
+  char *bp;
+#ifdef MM_THREADS
+  arena_t *a = NULL;
+#endif
+  for (i = 0; i < n; ++i) {
+    if ((bp = ptrs[i]) == NULL) {
+      continue;
+    }
+    if (!IS_SLAB(bp) && IS_MMAPPED(bp)) {
+      mmap_free(bp);
+      continue;
+    }
+#ifdef MM_THREADS
+    if (arena_of(bp) != a) {
+      if (a != NULL) {
+        arena_leave();
+      }
+      arena_enter(a = arena_of(bp));
+    }
+#endif
+    if (IS_SLAB(bp)) {
+      slab_free(bp);
+    } else if (!quick_put(bp)) {
+      ptrs[m++] = bp;
+    }
+  }
+  if (m > 1) {
+    qsort(ptrs, m, sizeof(void *), ptr_cmp);
+  }
+  for (i = 0; i < m; i = j) {
+    bp = ptrs[i];
+#ifdef MM_THREADS
+    if (arena_of(bp) != a) {
+      if (a != NULL) {
+        arena_leave();
+      }
+      arena_enter(a = arena_of(bp));
+    }
+#endif
+    for (j = i + 1; j < m && ptrs[j] == NEXT_BLKP(bp); ++j) {
+      PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)) + GET_SIZE(HDRP(ptrs[j])),
+                         GET_PREV_ALLOC(HDRP(bp)) | 1));
+    }
+    COUNT(coalesces, j - i - 1);
+    free_block(bp);
+  }
+#ifdef MM_THREADS
+  if (a != NULL) {
+    arena_leave();
+  }
+#endif
+}
 
+static int ptr_cmp(const void *a, const void *b) {
+  char *x = *(char *const *)a, *y = *(char *const *)b;
+  return (x > y) - (x < y);
+}
 
+static void free_block(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  char *lo = bp, *hi = (char *)bp + size - WSIZE; // 这次释放的范围
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+  PUT(FTRP(bp), PACK(size, 0));
+  CLR_PREV_ALLOC(bp);
+
+  // 立即合并
+  bp = imme_coalesce(bp);
+  size = GET_SIZE(HDRP(bp));
+  if (size >= TRIM_THRESHOLD && HDRP(NEXT_BLKP(bp)) == cur_arena->epilogue) {
+    heap_trim(bp);
+  } else if (size >= RELEASE_THRESHOLD && hi - lo >= HEAP_PAGE_SIZE) {
+    // 链接和脚部所在的字要保留，只释放新加入的部分
+    lo = MAX(lo, (char *)bp + DSIZE);
+    hi = MIN(hi, FTRP(bp));
+    mem_release(lo, hi - lo);
+  }
+  add_block(bp);
+}
+
+/*
+ * mm_realloc - 先尝试原地调整：缩小时把多余部分切出去，扩大时优先合并后面的
+ *     空闲块（不需要移动数据），不够再连同前面的空闲块一起合并并把数据前移，
+ *     都不行才重新分配
+ */
+void *mm_realloc(void *ptr, size_t size) {
+  size_t asize, target, old_size, new_size, prev_size, next_size;
+  unsigned int count = 0;
+  void *new_bp, *next;
+  grow_t *grow;
 
   /* 根据题目要求对特殊情况进行了判定 */
   if (ptr == NULL) {
@@ -231,53 +933,262 @@ void *mm_realloc(void *ptr, size_t size) {
     return NULL;
   }
 
-  asize = size <= DSIZE ? 2 * DSIZE
-                        : DSIZE * ((size + DSIZE + (DSIZE - 1)) / DSIZE);
-  new_bp = imme_coalesce(ptr); // 先尝试一下在 ptr 旁边是否有足够的空闲
-  new_bp_size = GET_SIZE(HDRP(new_bp)); // 指向能够合并得到的最大空闲块
+  if (IS_SLAB(ptr)) {
+    old_size = SLAB_OF(ptr)->size;
+    if (size <= old_size && SLAB_SIZE(size) == old_size) {
+      return ptr;
+    }
+    if ((new_bp = mm_malloc(size)) == NULL) {
+      return NULL;
+    }
+    memcpy(new_bp, ptr, MIN(size, old_size));
+    mm_free(ptr);
+    return new_bp;
+  }
+  if (IS_MMAPPED(ptr)) {
+    if (size >= MMAP_THRESHOLD / 2) { // 不太小就继续留在映射中
+      return mmap_resize(ptr, size);
+    }
+    if ((new_bp = mm_malloc(size)) == NULL) {
+      return NULL;
+    }
+    memcpy(new_bp, ptr, size);
+    mmap_free(ptr);
+    return new_bp;
+  }
 
-  PUT(HDRP(new_bp), PACK(new_bp_size, 1));
-  PUT(FTRP(new_bp), PACK(new_bp_size, 1));
+  if (size > SIZE_MAX - DSIZE - WSIZE) { // ASIZE 会溢出
+    errno = ENOMEM;
+    return NULL;
+  }
+  asize = ASIZE(size);
+#ifdef MM_THREADS
+  arena_enter(arena_of(ptr));
+#endif
+  new_bp = ptr;
+  new_size = old_size = GET_SIZE(HDRP(ptr));
+  target = asize;
+  if (old_size < asize) {
+    grow = &cur_arena->grow[GROW_SLOT(ptr)];
+    count = grow->bp == ptr ? grow->count + 1 : 1;
+    target = asize + ALIGN(GROW_HEADROOM(asize, count));
+    next = NEXT_BLKP(ptr);
+    next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+    prev_size = GET_PREV_ALLOC(HDRP(ptr)) ? 0 : GET_SIZE((char *)ptr - DSIZE);
+    if (old_size + next_size >= asize) {
+      delete_block(next);
+    } else if (extend_tail(ptr, asize) == 0) {
+      // 块在堆的末尾，直接向后扩堆，不需要移动
+      new_size = GET_SIZE(HDRP(ptr));
+      next_size = 0;
+    } else if (prev_size + old_size + next_size >= asize) {
+      // 合并了之前的空闲块，将原本的内容前移
+      new_bp = PREV_BLKP(ptr);
+      delete_block(new_bp);
+      if (next_size) {
+        delete_block(next);
+      }
+      memmove(new_bp, ptr, old_size - WSIZE);
+      new_size += prev_size;
+    } else { // 只能重新进行分配，并留出余量
+#ifdef MM_THREADS
+      arena_leave(); // mm_malloc 和 mm_free 会自己加锁
+#endif
+      if ((new_bp = mm_malloc(target - WSIZE)) == NULL) {
+        return NULL;
+      }
+      memcpy(new_bp, ptr, old_size - WSIZE); // 迁移
+      mm_free(ptr);
+      if (!IN_HEAP(new_bp)) { // 新块是单独映射的，不用记录
+        return new_bp;
+      }
+#ifdef MM_THREADS
+      arena_enter(arena_of(new_bp));
+#endif
+      grow = &cur_arena->grow[GROW_SLOT(new_bp)];
+      grow->bp = new_bp;
+      grow->count = count;
+#ifdef MM_THREADS
+      arena_leave();
+#endif
+      return new_bp;
+    }
+    new_size += next_size;
+    PUT(HDRP(new_bp), PACK(new_size, GET_PREV_ALLOC(HDRP(new_bp)) | 1));
+    SET_PREV_ALLOC(new_bp);
+    grow = &cur_arena->grow[GROW_SLOT(new_bp)];
+    grow->bp = new_bp;
+    grow->count = count;
+  }
+  if (new_bp == ptr) {
+    COUNT(realloc_inplace, 1);
+  }
+  // 扩大后位于堆末尾的块保留末尾的全部空间，免得被小块占住，下次就不能直接扩堆了
+  if (old_size >= asize || HDRP(NEXT_BLKP(new_bp)) != cur_arena->epilogue) {
+    shrink_block(new_bp, MIN(new_size, target));
+  }
+#ifdef MM_THREADS
+  arena_leave();
+#endif
+  return new_bp;
+}
 
-  if (new_bp != ptr) { // 如果合并了之前的空闲块，那么直接将原本的内容前移
-    memmove(new_bp, ptr, GET_SIZE(HDRP(ptr)) - DSIZE);
+/*
+ * shrink_block - 把已分配块 bp 缩小到 asize，剩余部分足够大时作为空闲块释放
+ */
+static void shrink_block(void *bp, size_t asize) {
+  size_t remain_size = GET_SIZE(HDRP(bp)) - asize;
+  if (remain_size < SPLIT_THRESHOLD) {
+    return;
   }
+  COUNT(splits, 1);
+  PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(remain_size, PREV_ALLOC | 1));
+  free_block(NEXT_BLKP(bp));
+}
 
-  if (new_bp_size == asize) {
-    return new_bp;
-  } else if (new_bp_size > asize) {
-    size_t remain_size = new_bp_size - asize;
-    if (remain_size >= 2 * DSIZE) {
-      PUT(HDRP(new_bp), PACK(asize, 1));
-      PUT(FTRP(new_bp), PACK(asize, 1));
-      PUT(HDRP(NEXT_BLKP(new_bp)), PACK(remain_size, 0));
-      PUT(FTRP(NEXT_BLKP(new_bp)), PACK(remain_size, 0));
-      add_block(NEXT_BLKP(new_bp));
-    }
-    // place(new_bp, asize);
-    return new_bp;
-  } else { // 只能重新进行分配
-    ptr = mm_malloc(asize);
-    if (ptr == NULL) {
-      return NULL;
-    }
-    memmove(ptr, new_bp, new_bp_size - DSIZE); // 迁移
-    mm_free(new_bp);
-    return ptr;
+/*
+ * extend_tail - bp（加上后面的空闲块）是 arena 的最后一个块时，直接向 mem_sbrk
+ *     申请不足的部分，把 bp 扩大到至少 asize。bp 不在末尾或扩堆失败时返回 -1
+ */
+static int extend_tail(void *bp, size_t asize) {
+  char *next = NEXT_BLKP(bp), *p;
+  size_t size = GET_SIZE(HDRP(bp)), incr;
+  if (!GET_ALLOC(HDRP(next))) {
+    size += GET_SIZE(HDRP(next));
+    next = NEXT_BLKP(next);
+  }
+  if (HDRP(next) != cur_arena->epilogue) {
+    return -1;
+  }
+  if (asize - size > INT_MAX) { // mem_sbrk 的参数是 int，放不下
+    return -1;
+  }
+  incr = asize - size;
+#ifdef MM_THREADS
+  incr = PAGE_ALIGN(incr);
+#endif
+  if ((p = heap_sbrk(incr)) == (void *)-1) {
+    return -1;
   }
+  if (HDRP(p) != cur_arena->epilogue) { // 其他 arena 先扩了堆，新空间不相连
+    init_chunk(p, incr);
+    return -1;
+  }
+  if (size != GET_SIZE(HDRP(bp))) {
+    delete_block(NEXT_BLKP(bp));
+  }
+  PUT(HDRP(bp), PACK(size + incr, GET_PREV_ALLOC(HDRP(bp)) | 1));
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, PREV_ALLOC | 1));
+  cur_arena->epilogue = HDRP(NEXT_BLKP(bp));
+  return 0;
 }
 
 static void *expend_heap(size_t words) {
   size_t size;
   void *bp;
   size = (words % 2 ? (words + 1) : words) * WSIZE;
-  if ((bp = mem_sbrk(size)) == (void *)-1) {
+#ifdef MM_THREADS
+  // 留出新序言块的空间，再按页对齐
+  size = PAGE_ALIGN(size + 4 * WSIZE);
+#endif
+  if ((bp = heap_sbrk(size)) == (void *)-1) {
     return NULL;
   }
+  return init_chunk(bp, size);
+}
 
-  PUT(HDRP(bp), PACK(size, 0));         // 设置头部
-  PUT(FTRP(bp), PACK(size, 0));         // 设置脚部
-  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); // 设置新的结尾块
+/*
+ * heap_sbrk - 向 memlib 申请空间；多 arena 模式下加锁并记录这些页属于当前 arena
+ */
+static void *heap_sbrk(size_t size) {
+  char *p, *fresh;
+  if (size > INT_MAX) { // mem_sbrk 的参数是 int
+    errno = ENOMEM;
+    return (void *)-1;
+  }
+  if (cur_arena->trim_mark != NULL) { // 又用到了刚还回去的空间
+    cur_arena->trim_threshold =
+        MIN(cur_arena->trim_threshold * 2, MAX_TRIM_THRESHOLD);
+    cur_arena->trim_mark = NULL;
+  }
+  COUNT(sbrk_calls, 1);
+  COUNT(sbrk_bytes, size);
+#ifdef MM_THREADS
+  pthread_mutex_lock(&sbrk_lock);
+  fresh = mem_heap_fresh();
+  if ((p = mem_sbrk(size)) != (void *)-1) {
+    memset(page_map + PAGE_INDEX(p), cur_arena - arenas,
+           size >> HEAP_PAGE_SHIFT);
+  }
+  pthread_mutex_unlock(&sbrk_lock);
+#else
+  fresh = mem_heap_fresh();
+  p = mem_sbrk(size);
+#endif
+  if (p != (void *)-1) {
+    fresh_lo = MAX(p, fresh);
+    fresh_hi = p + size;
+  }
+  return p;
+}
+
+/*
+ * heap_unsbrk - 堆的末尾正好是 end 时，把最后 size 字节还给 memlib
+ */
+static int heap_unsbrk(char *end, size_t size) {
+  int ret = -1;
+#ifdef MM_THREADS
+  pthread_mutex_lock(&sbrk_lock);
+#endif
+  if ((char *)mem_heap_hi() + 1 == end) { // 其他 arena 可能已经在后面扩了堆
+    ret = mem_trim(size);
+  }
+#ifdef MM_THREADS
+  pthread_mutex_unlock(&sbrk_lock);
+#endif
+  return ret;
+}
+
+/*
+ * heap_trim - bp 是 arena 末尾的大空闲块，把它缩小到 TRIM_PAD 左右，
+ *     多出来的整页还给 memlib
+ */
+static void heap_trim(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  size_t incr = (size - TRIM_PAD) & ~(HEAP_PAGE_SIZE - 1);
+  if (size < cur_arena->trim_threshold ||
+      heap_unsbrk(NEXT_BLKP(bp), incr) < 0) {
+    return;
+  }
+  cur_arena->trim_mark = NEXT_BLKP(bp);
+  size -= incr;
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+  PUT(FTRP(bp), PACK(size, 0));
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); // 新的结尾块
+  cur_arena->epilogue = HDRP(NEXT_BLKP(bp));
+}
+
+/*
+ * init_chunk - 将新申请到的 [p, p + size) 变成空闲块并加入空闲链表。
+ *     如果它紧接在当前 arena 的结尾块之后，旧结尾块就成为新块的头部；
+ *     否则（中间夹着其他 arena 的空间）先在开头放一个新的序言块
+ */
+static void *init_chunk(char *p, size_t size) {
+  char *bp = p;
+  if (HDRP(bp) != cur_arena->epilogue) {
+    PUT(p + 1 * WSIZE, PACK(DSIZE, 1));
+    PUT(p + 2 * WSIZE, PACK(DSIZE, 1));
+    PUT(p + 3 * WSIZE, PACK(0, PREV_ALLOC | 1)); // 新块前面是序言块
+    bp += 4 * WSIZE;
+    size -= 4 * WSIZE;
+  }
+
+  // 旧结尾块中的 PREV_ALLOC 位保留下来
+  PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); // 设置头部
+  PUT(FTRP(bp), PACK(size, 0));                        // 设置脚部
+  PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));                // 设置新的结尾块
+  cur_arena->epilogue = HDRP(NEXT_BLKP(bp));
 
   PUT(PRED(bp), NONE_BLKP);
   PUT(SUCC(bp), NONE_BLKP);
@@ -289,118 +1200,163 @@ static void *expend_heap(size_t words) {
 
 static void *imme_coalesce(void *bp) {
 
-  size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))); // 获得上一个块的已分配位
+  size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp)); // 获得上一个块的已分配位
   size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp))); // 获得下一个块的已分配位
   size_t size = GET_SIZE(HDRP(bp));
   if (prev_alloc && next_alloc) { // 如果前后两个块都已经分配了
     return bp;
-  } else if (prev_alloc && !next_alloc) { // 如果后一个块还未分配
+  }
+  COUNT(coalesces, 2 - (prev_alloc != 0) - (next_alloc != 0));
+  if (prev_alloc && !next_alloc) { // 如果后一个块还未分配
     size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
     delete_block(NEXT_BLKP(bp));
-    PUT(HDRP(bp), PACK(size, 0));
+    PUT(HDRP(bp), PACK(size, PREV_ALLOC));
     PUT(FTRP(bp), PACK(size, 0));
   } else if (!prev_alloc && next_alloc) {
     size += GET_SIZE(FTRP(PREV_BLKP(bp)));
     delete_block(PREV_BLKP(bp));
-    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
     PUT(FTRP(bp), PACK(size, 0));
     bp = PREV_BLKP(bp);
   } else {
     size += GET_SIZE(HDRP(NEXT_BLKP(bp))) + GET_SIZE(FTRP(PREV_BLKP(bp)));
     delete_block(PREV_BLKP(bp));
     delete_block(NEXT_BLKP(bp));
-    PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
+    PUT(HDRP(PREV_BLKP(bp)), PACK(size, GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
     PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
     bp = PREV_BLKP(bp);
   }
   return bp;
 }
 
+/*
+ * delay_coalesce - 把当前 arena 快速链表中的块全部真正释放，和周围的空闲块合并
+ */
 static void delay_coalesce(void) {
-  // 遍历链表中所有的空闲块，如果是空闲块，则尝试将其与周围的块进行合并
-  for (void *bp = heap_listp; GET_SIZE(HDRP(bp)) != 0; bp = NEXT_BLKP(bp)) {
-    if (!GET_ALLOC(HDRP(bp))) {
-      bp = imme_coalesce(bp);
+  void *bp;
+  for (int i = 0; i < QUICK_BINS; ++i) {
+    while ((bp = cur_arena->quick[i]) != NULL) {
+      cur_arena->quick[i] = SUCC_BLKP(bp);
+      free_block(bp);
     }
   }
+  cur_arena->quick_count = 0;
 }
 
 static void *first_fit(size_t asize) {
-  // size_t size;
-
-  // for (void *bp = heap_listp; (size = GET_SIZE(HDRP(bp))) != 0;
-  //      bp = NEXT_BLKP(bp)) {
-  //   if (size > asize && !GET_ALLOC(HDRP(bp))) {
-  //     return bp;
-  //   }
-  // }
-
-  // return NULL;
   int index = get_index_by_size(asize);
+  unsigned int map;
   void *succ;
-  while (index <= 8) {
-    succ = listp + index * WSIZE;
-    while ((succ = SUCC_BLKP(succ)) != NONE_BLKP) {
-      if (GET_SIZE(HDRP(succ)) >= asize && !GET_ALLOC(HDRP(succ))) {
+  // asize 所在的大小类中的块不一定都够大，需要逐个检查
+  succ = listp + index * WSIZE;
+  if (index == LARGE_CLASS) {
+    return tree_best_fit(GET_BLKP(succ), asize);
+  } else if (TREE_CLASS(index)) {
+    if ((succ = tree_first_fit(GET_BLKP(succ), asize)) != NULL) {
+      return succ;
+    }
+  } else {
+    while ((succ = SUCC_BLKP(succ)) != NULL) {
+      if (GET_SIZE(HDRP(succ)) >= asize) {
         return succ;
       }
     }
-    ++index;
   }
-  return NULL;
+  // 更大的大小类中任何一个块都满足要求，直接用位图找到第一个非空的大小类
+  map = GET(BITMAP(listp)) & (~0u << (index + 1));
+  if (map == 0) {
+    return NULL;
+  }
+  index = __builtin_ctz(map);
+  succ = GET_BLKP(listp + index * WSIZE);
+  if (index == LARGE_CLASS) {
+    return tree_best_fit(succ, asize); // 最小的大块
+  } else if (TREE_CLASS(index)) {
+    // 地址最低的块
+    while (GET(LEFT(succ)) != NONE_BLKP) {
+      succ = GET_BLKP(LEFT(succ));
+    }
+  }
+  return succ;
 }
 
 static void *best_fit(size_t asize) {
-  // size_t size;
-  // void *best = NULL; // 最佳的块
-
-  // size_t min_size = 0;
-
-  // for (void *bp = heap_listp; (size = GET_SIZE(bp)) != 0; bp = NEXT_BLKP(bp))
-  // {
-  //   if (size >= asize && !GET_ALLOC(HDRP(bp)) &&
-  //       (min_size == 0 || min_size > size)) {
-  //     min_size = size;
-  //     best = bp;
-  //   }
-  // }
-  // return best;
   int index = get_index_by_size(asize);
-  void *best = NULL; // 最佳的块
-  size_t min_size = 0, size;
-  void *succ;
-  while (index <= 8) {
-    succ = listp + index * WSIZE;
-    while ((succ = SUCC_BLKP(succ)) != NONE_BLKP) {
-      size = GET_SIZE(HDRP(succ));
-      if (size >= asize && !GET_ALLOC(HDRP(succ)) &&
-          (min_size == 0 || min_size > size)) {
-        best = succ;
-        min_size = size;
-      }
-      if (best != NULL) {
-        return best;
+  void *root = listp + index * WSIZE;
+  void *best; // 最佳的块
+  unsigned int map;
+
+  if (index == LARGE_CLASS) {
+    return tree_best_fit(GET_BLKP(root), asize);
+  }
+  if ((best = class_best_fit(root, asize, NULL)) != NULL) {
+    return best;
+  }
+  // 在更大的第一个非空大小类中找最小的块
+  map = GET(BITMAP(listp)) & (~0u << (index + 1));
+  if (map == 0) {
+    return NULL;
+  }
+  index = __builtin_ctz(map);
+  root = listp + index * WSIZE;
+  if (index == LARGE_CLASS) {
+    return tree_best_fit(GET_BLKP(root), asize);
+  }
+  return class_best_fit(root, asize, NULL);
+}
+
+/*
+ * class_best_fit - 在一个小大小类中找不小于 asize 的最小块，best 为目前找到的最佳块
+ */
+static void *class_best_fit(void *root, size_t asize, void *best) {
+  void *node = GET_BLKP(root);
+  size_t size;
+  while (node != NULL) {
+    size = GET_SIZE(HDRP(node));
+    if (size >= asize && (best == NULL || size < GET_SIZE(HDRP(best)))) {
+      best = node;
+      if (size == asize) {
+        break;
       }
-      ++index;
     }
+    if (!ADDRESS_ORDER) {
+      node = SUCC_BLKP(node);
+      continue;
+    }
+    best = class_best_fit(LEFT(node), asize, best);
+    node = GET_BLKP(RIGHT(node));
   }
-  return NULL;
+  return best;
 }
 
-static void place(void *bp, size_t asize) {
+/*
+ * place - 从空闲块 bp 中分配 asize 字节，返回分配出的块。剩余部分足够大时分割出
+ *     一个新的空闲块：小块从高地址一端切出，大块从低地址一端切出，这样小块和大块
+ *     分别聚在空闲块的两头，小块不会把大的空闲区域隔开
+ */
+static void *place(void *bp, size_t asize) {
   size_t remain_size = GET_SIZE(HDRP(bp)) - asize;
   delete_block(bp);
-  if (remain_size >=
-      DSIZE * 2) { // 如果剩余空间满足最小块的大小，就将其分割出一个新的空闲块
+  if (remain_size >= SPLIT_THRESHOLD && asize < SMALL_PLACE) {
+    COUNT(splits, 1);
+    PUT(HDRP(bp), PACK(remain_size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(remain_size, 0));
+    add_block(bp);
+    bp = NEXT_BLKP(bp);
     PUT(HDRP(bp), PACK(asize, 1));
-    PUT(FTRP(bp), PACK(asize, 1));
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(remain_size, 0));
+    SET_PREV_ALLOC(bp);
+  } else if (remain_size >=
+      SPLIT_THRESHOLD) { // 如果剩余空间足够大，就将其分割出一个新的空闲块
+    COUNT(splits, 1);
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(remain_size, PREV_ALLOC));
     PUT(FTRP(NEXT_BLKP(bp)), PACK(remain_size, 0));
     add_block(NEXT_BLKP(bp));
   } else {
-    PUT(HDRP(bp), PACK(GET_SIZE(HDRP(bp)), 1));
-    PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 1));
+    PUT(HDRP(bp), GET(HDRP(bp)) | 1); // 已分配块没有脚部
+    SET_PREV_ALLOC(bp);
   }
+  return bp;
 }
 
 static void *add_block(void *bp) {
@@ -408,65 +1364,411 @@ static void *add_block(void *bp) {
   int index = get_index_by_size(size);
   void *root = listp + index * WSIZE; // 得到对应空闲链表的 root 指针
 
-  // LIFO
-  // return LIFO(bp, root);
-  // address_order
-  return address_order(bp, root);
+  PUT(BITMAP(listp), GET(BITMAP(listp)) | (1u << index));
+
+  if (TREE_CLASS(index)) {
+    return tree_insert(root, bp, index == LARGE_CLASS);
+  }
+  return LIFO(bp, root);
 }
 
 static void delete_block(void *bp) {
-  PUT(SUCC(PRED_BLKP(bp)), SUCC_BLKP(bp)); // 将上一个块的后继改为当前块的后继
-  if (SUCC_BLKP(bp) != NONE_BLKP) {
-    PUT(PRED(SUCC_BLKP(bp)), PRED_BLKP(bp));
+  int index = get_index_by_size(GET_SIZE(HDRP(bp)));
+  void *root = listp + index * WSIZE;
+  if (TREE_CLASS(index)) {
+    tree_delete(root, bp, index == LARGE_CLASS);
+  } else {
+    PUT(SUCC(PRED_BLKP(bp)), GET(SUCC(bp))); // 将上一个块的后继改为当前块的后继
+    if (SUCC_BLKP(bp) != NULL) {
+      PUT(PRED(SUCC_BLKP(bp)), GET(PRED(bp)));
+    }
+  }
+  if (GET(root) == NONE_BLKP) { // 链表空了，清除位图中对应的位
+    PUT(BITMAP(listp), GET(BITMAP(listp)) & ~(1u << index));
   }
 }
 
 static int get_index_by_size(size_t size) {
-  int index = 0;
-  if (size > 4096) {
-    return 8;
+  int fl;
+  if (size < 64) {
+    return size / DSIZE - 2;
   }
-  size >>= 5;
-  while (size) {
-    size >>= 1;
-    ++index;
+  if (size >= 4096) {
+    return NUM_CLASSES - 1;
   }
-  return index;
+  fl = 31 - __builtin_clz(size); // 最高位，6~11
+  return 6 + (fl - 6) * 4 + ((size >> (fl - 2)) & 3);
 }
 
 static void *LIFO(void *bp, void *root) {
   // 使用头插法进行插入
-  if (SUCC_BLKP(root) != NONE_BLKP) { // 如果后继不为空
-    PUT(PRED(SUCC_BLKP(root)), bp);
-    PUT(SUCC(bp), SUCC_BLKP(root));
+  if (SUCC_BLKP(root) != NULL) { // 如果后继不为空
+    PUT_BLKP(PRED(SUCC_BLKP(root)), bp);
+    PUT(SUCC(bp), GET(SUCC(root)));
   } else {
     PUT(SUCC(bp), NONE_BLKP);
   }
-  PUT(SUCC(root), bp);
-  PUT(PRED(bp), root);
+  PUT_BLKP(SUCC(root), bp);
+  PUT_BLKP(PRED(bp), root);
 
   return bp;
 }
 
-static void *address_order(void *bp, void *root) {
-  void *succ = root;
-  while (SUCC_BLKP(succ) != NONE_BLKP) {
-    succ = SUCC_BLKP(succ);
-    if (succ >= bp) {
-      break;
+/*
+ * tree_insert - 把 bp 插入以 root 为根的 treap。先沿着优先级比 bp 高的结点
+ *     往下走，再把剩下的子树按键拆成两半，分别作为 bp 的左右子树。
+ *     by_size 为 0 时以地址为键，否则以 (大小, 地址) 为键
+ */
+static void *tree_insert(void *root, void *bp, int by_size) {
+  char *link = root;
+  void *node, *left, *right;
+  unsigned int prio = priority(bp);
+
+  while ((node = GET_BLKP(link)) != NULL &&
+         priority(node) > prio) {
+    link = key_less(bp, node, by_size) ? LEFT(node) : RIGHT(node);
+  }
+  PUT_BLKP(link, bp);
+
+  left = LEFT(bp);
+  right = RIGHT(bp);
+  while (node != NULL) {
+    if (key_less(node, bp, by_size)) {
+      PUT_BLKP(left, node);
+      left = RIGHT(node);
+      node = GET_BLKP(left);
+    } else {
+      PUT_BLKP(right, node);
+      right = LEFT(node);
+      node = GET_BLKP(right);
     }
   }
-  if (succ == root) {
-    return LIFO(bp, root);
-  } else if (SUCC_BLKP(succ) == NONE_BLKP) {
-    PUT(SUCC(succ), bp);
-    PUT(PRED(bp), succ);
-    PUT(SUCC(bp), NONE_BLKP);
+  PUT(left, NONE_BLKP);
+  PUT(right, NONE_BLKP);
+  return bp;
+}
+
+/*
+ * tree_delete - 从以 root 为根的 treap 中删除 bp，用它左右子树合并的结果代替它
+ */
+static void tree_delete(void *root, void *bp, int by_size) {
+  char *link = root;
+  void *node, *left, *right;
+
+  while ((node = GET_BLKP(link)) != bp) {
+    link = key_less(bp, node, by_size) ? LEFT(node) : RIGHT(node);
+  }
+  left = GET_BLKP(LEFT(bp));
+  right = GET_BLKP(RIGHT(bp));
+  while (left != NULL && right != NULL) {
+    if (priority(left) > priority(right)) {
+      PUT_BLKP(link, left);
+      link = RIGHT(left);
+      left = GET_BLKP(link);
+    } else {
+      PUT_BLKP(link, right);
+      link = LEFT(right);
+      right = GET_BLKP(link);
+    }
+  }
+  PUT_BLKP(link, left != NULL ? left : right);
+}
+
+/*
+ * tree_first_fit - 按地址从小到大找第一个不小于 asize 的块
+ */
+static void *tree_first_fit(void *node, size_t asize) {
+  void *bp;
+  while (node != NULL) {
+    if ((bp = tree_first_fit(GET_BLKP(LEFT(node)), asize)) != NULL) {
+      return bp;
+    }
+    if (GET_SIZE(HDRP(node)) >= asize) {
+      return node;
+    }
+    node = GET_BLKP(RIGHT(node));
+  }
+  return NULL;
+}
+
+/*
+ * tree_best_fit - 在以 (大小, 地址) 为键的 treap 中找不小于 asize 的最小块
+ */
+static void *tree_best_fit(void *node, size_t asize) {
+  void *best = NULL;
+  while (node != NULL) {
+    if (GET_SIZE(HDRP(node)) >= asize) {
+      best = node;
+      node = GET_BLKP(LEFT(node));
+    } else {
+      node = GET_BLKP(RIGHT(node));
+    }
+  }
+  return best;
+}
+
+static int key_less(void *a, void *b, int by_size) {
+  if (by_size && GET_SIZE(HDRP(a)) != GET_SIZE(HDRP(b))) {
+    return GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b));
+  }
+  return a < b;
+}
+
+/*
+ * priority - treap 结点的优先级，由地址散列得到，不占用块中的空间
+ */
+static unsigned int priority(void *bp) {
+  unsigned int x = TO_OFFSET(bp);
+  x = (x ^ (x >> 16)) * 0x45d9f3b;
+  x = (x ^ (x >> 16)) * 0x45d9f3b;
+  return x ^ (x >> 16);
+}
+
+/*
+ * slab_alloc - 从 size 对应大小类的第一个还有空闲槽的 slab 中取一个槽
+ */
+static void *slab_alloc(size_t size) {
+  char *root = SLAB_ROOT(listp, SLAB_INDEX(size));
+  slab_t *slab;
+  int i, bit;
+
+  if (GET(root) == NONE_BLKP && slab_new(root, SLAB_SIZE(size)) == NULL) {
+    return NULL;
+  }
+  slab = GET_BLKP(root);
+  for (i = 0; slab->map[i] == 0; ++i) {
+  }
+  bit = __builtin_ctz(slab->map[i]);
+  slab->map[i] &= ~(1u << bit);
+  if (--slab->nfree == 0) { // 满了，不再留在链表中
+    slab_unlink(root, slab);
+  }
+  return (char *)slab + SLAB_HDR + (i * 32 + bit) * slab->size;
+}
+
+static void slab_free(void *ptr) {
+  slab_t *slab = SLAB_OF(ptr);
+  char *root = SLAB_ROOT(listp, SLAB_INDEX(slab->size));
+  int i = ((char *)ptr - (char *)slab - SLAB_HDR) / slab->size;
+
+  slab->map[i / 32] |= 1u << (i % 32);
+  if (slab->nfree++ == 0) { // 之前是满的，重新放回链表
+    slab_link(root, slab);
+  } else if (slab->nfree == slab->nslots &&
+             (slab->prev != NONE_BLKP || slab->next != NONE_BLKP)) {
+    // 整页都空了，并且这个大小类还有别的 slab，就把这一页还给堆
+    slab_unlink(root, slab);
+    page_map[PAGE_INDEX(slab)] &= ~PAGE_SLAB;
+    free_block(slab);
+  }
+}
+
+/*
+ * slab_new - 从堆中分配一个对齐的页，切成大小为 slot 的槽
+ */
+static slab_t *slab_new(char *root, size_t slot) {
+  slab_t *slab;
+  int i;
+  if ((slab = aligned_block(HEAP_PAGE_SIZE, ASIZE(HEAP_PAGE_SIZE))) == NULL) {
+    return NULL;
+  }
+  page_map[PAGE_INDEX(slab)] |= PAGE_SLAB;
+  slab->size = slot;
+  slab->nslots = slab->nfree = (HEAP_PAGE_SIZE - SLAB_HDR) / slot;
+  memset(slab->map, 0, sizeof(slab->map));
+  for (i = 0; i < slab->nslots; ++i) {
+    slab->map[i / 32] |= 1u << (i % 32);
+  }
+  slab_link(root, slab);
+  return slab;
+}
+
+static void slab_link(char *root, slab_t *slab) {
+  slab->prev = NONE_BLKP;
+  slab->next = GET(root);
+  if (slab->next != NONE_BLKP) {
+    ((slab_t *)TO_BLKP(slab->next))->prev = TO_OFFSET(slab);
+  }
+  PUT_BLKP(root, slab);
+}
+
+static void slab_unlink(char *root, slab_t *slab) {
+  if (slab->prev == NONE_BLKP) {
+    PUT(root, slab->next);
   } else {
-    PUT(SUCC(PRED_BLKP(succ)), bp);
-    PUT(PRED(bp), PRED_BLKP(succ));
-    PUT(SUCC(bp), succ);
-    PUT(PRED(succ), bp);
+    ((slab_t *)TO_BLKP(slab->prev))->next = slab->next;
+  }
+  if (slab->next != NONE_BLKP) {
+    ((slab_t *)TO_BLKP(slab->next))->prev = slab->prev;
+  }
+}
+
+/*
+ * mm_stats - 汇总各 arena 的计数，并遍历所有空闲链表统计空闲块
+ */
+void mm_stats(mm_stats_t *st) {
+  arena_t *a;
+  memset(st, 0, sizeof(*st));
+  for (a = arenas; a < arenas + NARENAS; ++a) {
+#ifdef MM_THREADS
+    pthread_mutex_lock(&a->lock);
+#endif
+    if (a->listp != NULL) {
+      for (int index = 0; index < NUM_CLASSES; ++index) {
+        stats_free(st, index, GET_BLKP(a->listp + index * WSIZE));
+      }
+      // 快速链表中的块虽然标记为已分配，其实也是空闲的
+      for (int i = 0; i < QUICK_BINS; ++i) {
+        for (void *bp = a->quick[i]; bp != NULL; bp = SUCC_BLKP(bp)) {
+          stats_cached(st, bp);
+        }
+      }
+      st->sbrk_calls += a->count.sbrk_calls;
+      st->sbrk_bytes += a->count.sbrk_bytes;
+      st->coalesces += a->count.coalesces;
+      st->splits += a->count.splits;
+      st->realloc_inplace += a->count.realloc_inplace;
+    }
+#ifdef MM_THREADS
+    pthread_mutex_unlock(&a->lock);
+#endif
+  }
+#ifdef MM_THREADS
+  // 只能看到当前线程的 tcache，其他线程的 tcache 不算在内
+  if (tcache.generation == mm_generation) {
+    for (int i = 0; i < TCACHE_BINS; ++i) {
+      for (void *bp = tcache.head[i]; bp != NULL; bp = *(void **)bp) {
+        stats_cached(st, bp);
+      }
+    }
+  }
+#endif
+  if (st->free_total > 0) {
+    st->fragmentation = 1.0 - (double)st->largest_free / st->free_total;
   }
+}
+
+/*
+ * stats_free - 统计大小类 index 中以 node 开始的链表或树里的空闲块
+ */
+static void stats_free(mm_stats_t *st, int index, void *node) {
+  while (node != NULL) {
+    stats_block(st, index, GET_SIZE(HDRP(node)));
+    if (TREE_CLASS(index)) {
+      stats_free(st, index, GET_BLKP(LEFT(node)));
+      node = GET_BLKP(RIGHT(node));
+    } else {
+      node = SUCC_BLKP(node);
+    }
+  }
+}
+
+/*
+ * stats_cached - 统计快速链表或 tcache 中的块 bp，按它的大小算进对应的大小类
+ */
+static void stats_cached(mm_stats_t *st, void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  stats_block(st, get_index_by_size(size), size);
+}
+
+static void stats_block(mm_stats_t *st, int index, size_t size) {
+  st->free_count[index]++;
+  st->free_bytes[index] += size;
+  st->free_blocks++;
+  st->free_total += size;
+  st->largest_free = MAX(st->largest_free, size);
+}
+
+#ifdef MM_THREADS
+static void mm_once_init(void) {
+  for (int i = 0; i < NARENAS; ++i) {
+    pthread_mutex_init(&arenas[i].lock, NULL);
+  }
+  pthread_key_create(&tcache_key, tcache_flush);
+}
+
+/*
+ * thread_arena - 返回当前线程绑定的 arena，第一次调用时轮流选一个
+ */
+static arena_t *thread_arena(void) {
+  if (tcache.generation != mm_generation) {
+    // 堆被 mm_init 重置过，tcache 中的块都已失效
+    memset(&tcache, 0, sizeof(tcache));
+    tcache.generation = mm_generation;
+    tcache.arena = &arenas[__sync_fetch_and_add(&next_arena, 1) % NARENAS];
+    pthread_setspecific(tcache_key, &tcache);
+  }
+  return tcache.arena;
+}
+
+/*
+ * arena_of - 根据块所在的页找到它所属的 arena
+ */
+static arena_t *arena_of(void *bp) {
+  return &arenas[page_map[PAGE_INDEX(bp)] & PAGE_ARENA];
+}
+
+/*
+ * arena_enter - 锁住 arena a 并切换到它的空闲链表，a 还没创建时先从堆中切出来
+ */
+static int arena_enter(arena_t *a) {
+  char *p;
+  pthread_mutex_lock(&a->lock);
+  cur_arena = a;
+  listp = a->listp;
+  if (listp == NULL) {
+    if ((p = heap_sbrk(CHUNKSIZE)) == (void *)-1) {
+      pthread_mutex_unlock(&a->lock);
+      return -1;
+    }
+    arena_init(a, p);
+    init_chunk(p + ARENA_WORDS * WSIZE, CHUNKSIZE - ARENA_WORDS * WSIZE);
+  }
+  return 0;
+}
+
+static void arena_leave(void) { pthread_mutex_unlock(&cur_arena->lock); }
+
+static void *tcache_get(size_t asize) {
+  void *bp;
+  int index = TCACHE_INDEX(asize);
+  if (asize > TCACHE_MAX || (bp = tcache.head[index]) == NULL) {
+    return NULL;
+  }
+  tcache.head[index] = *(void **)bp;
+  --tcache.count[index];
   return bp;
-}
\ No newline at end of file
+}
+
+static int tcache_put(void *bp) {
+  size_t size = GET_SIZE(HDRP(bp));
+  int index = TCACHE_INDEX(size);
+  thread_arena();
+  if (size > TCACHE_MAX || tcache.count[index] >= TCACHE_COUNT) {
+    return 0;
+  }
+  *(void **)bp = tcache.head[index];
+  tcache.head[index] = bp;
+  ++tcache.count[index];
+  return 1;
+}
+
+/*
+ * tcache_flush - 线程退出时把 tcache 中的块还给各自的 arena
+ */
+static void tcache_flush(void *arg) {
+  void *bp;
+  if (tcache.generation != mm_generation) {
+    return;
+  }
+  for (int i = 0; i < TCACHE_BINS; ++i) {
+    while ((bp = tcache.head[i]) != NULL) {
+      tcache.head[i] = *(void **)bp;
+      arena_enter(arena_of(bp));
+      free_block(bp);
+      arena_leave();
+    }
+    tcache.count[i] = 0;
+  }
+}
+#endif
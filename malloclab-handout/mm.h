@@ -4,6 +4,42 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern void *mm_memalign(size_t align, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+/*
+ * Batch entry points.  mm_malloc_batch() allocates up to n blocks of
+ * size bytes into ptrs[] and returns how many it got.  mm_free_batch()
+ * frees the n blocks in ptrs[] (NULL entries are ignored); it uses
+ * ptrs[] as scratch space, so its contents are undefined afterwards.
+ */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **ptrs);
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/*
+ * Allocator statistics filled in by mm_stats().  The free block
+ * fields describe the free blocks at the time of the call: those in
+ * the segregated free lists, the quick lists and the calling thread's
+ * cache.  The counters accumulate since the last mm_init().
+ */
+#define MM_STATS_CLASSES 31
+
+typedef struct {
+    size_t free_count[MM_STATS_CLASSES]; /* free blocks in each size class */
+    size_t free_bytes[MM_STATS_CLASSES]; /* ... and the bytes they hold */
+    size_t free_blocks;     /* free blocks in all classes */
+    size_t free_total;      /* bytes in all free blocks */
+    size_t largest_free;    /* size of the largest free block */
+    double fragmentation;   /* 1 - largest_free / free_total */
+    size_t sbrk_calls;      /* calls that grew the heap */
+    size_t sbrk_bytes;      /* bytes those calls added */
+    size_t coalesces;       /* merges of a free block with a neighbour */
+    size_t splits;          /* free blocks split to fit a request */
+    size_t realloc_inplace; /* reallocs that resized a block without moving */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
 
 
 /* 
@@ -0,0 +1,296 @@
+/*
+ * mmrecord.c - LD_PRELOAD library that logs every malloc, free and
+ *              realloc of a live process, so that rec2rep can turn
+ *              the log into an mdriver trace.  Build it with "make
+ *              librecord.so" and run, for example,
+ *
+ *                unix> LD_PRELOAD=$PWD/librecord.so ./proxy 15213
+ *                unix> ./rec2rep mmrecord.<pid> > proxy.rep
+ *
+ *              The log goes to $MM_RECORD.<pid>, or mmrecord.<pid> if
+ *              MM_RECORD is not set.  The calls themselves are served
+ *              by the libc allocator (__libc_malloc and friends).
+ *
+ *              Each call claims the next slot of a ring of buffers with
+ *              one atomic add and fills it in.  A writer thread appends
+ *              full buffers to the log, so a call only waits if the
+ *              writer falls a whole ring behind.  The log is completed
+ *              when the process exits normally; a process killed by a
+ *              signal loses the events still in the ring.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mmrecord.h"
+
+#define REC_BUF_EVENTS (1 << 16)  /* events per buffer */
+#define REC_NBUFS 16              /* buffers in the ring */
+#define REC_FLUSH_WAIT 1000       /* ms to wait for late events at exit */
+
+/* the real allocator */
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+
+typedef struct {
+    rec_event_t ev[REC_BUF_EVENTS];
+    atomic_ulong filled;  /* slots filled in so far */
+    atomic_ulong round;   /* seq / REC_BUF_EVENTS of the slots it holds */
+} rec_buf_t;
+
+static rec_buf_t *bufs;          /* the ring */
+static atomic_ulong seq;         /* next slot to claim */
+static atomic_int recording;     /* set once the writer runs */
+static atomic_int stopping;      /* tells the writer to finish up */
+static atomic_uint next_tid;
+static __thread int tid __attribute__((tls_model("initial-exec"))) = -1;
+static int fd = -1;              /* the log */
+static pthread_t writer;
+
+static void rec_log(uint32_t type, void *ptr, void *old, size_t size);
+static void *rec_writer(void *arg);
+static void rec_flush(rec_buf_t *b, unsigned long round, unsigned long n);
+static void rec_child(void);
+
+/*
+ * rec_start - open the log and start the writer thread.  Calls made
+ *     before this (or by pthread_create below) are not recorded.
+ */
+static void __attribute__((constructor)) rec_start(void)
+{
+    char path[4096];
+    char *prefix = getenv("MM_RECORD");
+    rec_header_t hdr;
+    int i;
+
+    bufs = mmap(NULL, REC_NBUFS * sizeof(rec_buf_t), PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufs == MAP_FAILED)
+	return;
+    for (i = 0; i < REC_NBUFS; i++)
+	atomic_init(&bufs[i].round, i);
+
+    snprintf(path, sizeof(path), "%s.%d", prefix ? prefix : "mmrecord",
+	     (int)getpid());
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+	perror("mmrecord: open");
+	return;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, REC_MAGIC);
+    hdr.event_size = sizeof(rec_event_t);
+    hdr.pid = getpid();
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+	return;
+
+    /* a forked child shares the log but not the writer thread */
+    pthread_atfork(NULL, NULL, rec_child);
+    if (pthread_create(&writer, NULL, rec_writer, NULL) != 0)
+	return;
+    atomic_store(&recording, 1);
+}
+
+/*
+ * rec_stop - flush what is left in the ring when the process exits
+ */
+static void __attribute__((destructor)) rec_stop(void)
+{
+    if (!atomic_exchange(&recording, 0))
+	return;
+    atomic_store(&stopping, 1);
+    pthread_join(writer, NULL);
+    close(fd);
+}
+
+static void rec_child(void)
+{
+    atomic_store(&recording, 0);
+}
+
+/*
+ * rec_log - append one event to the ring
+ */
+static void rec_log(uint32_t type, void *ptr, void *old, size_t size)
+{
+    unsigned long s, round;
+    rec_buf_t *b;
+    rec_event_t *e;
+
+    if (!atomic_load_explicit(&recording, memory_order_relaxed))
+	return;
+    if (tid < 0)
+	tid = atomic_fetch_add(&next_tid, 1);
+
+    s = atomic_fetch_add_explicit(&seq, 1, memory_order_relaxed);
+    round = s / REC_BUF_EVENTS;
+    b = &bufs[round % REC_NBUFS];
+
+    /* wait until the writer has emptied the buffer on its last lap */
+    while (atomic_load_explicit(&b->round, memory_order_acquire) != round)
+	sched_yield();
+
+    e = &b->ev[s % REC_BUF_EVENTS];
+    e->ptr = (uintptr_t)ptr;
+    e->old = (uintptr_t)old;
+    e->size = size;
+    e->type = type;
+    e->tid = tid;
+    atomic_fetch_add_explicit(&b->filled, 1, memory_order_release);
+}
+
+/*
+ * rec_writer - append buffers to the log in ring order as they fill up.
+ *     When stopping, flush every slot claimed so far, waiting a little
+ *     for calls that are still filling theirs in.
+ */
+static void *rec_writer(void *arg)
+{
+    unsigned long round = 0, end, n;
+    rec_buf_t *b;
+    int i;
+
+    for (;;) {
+	b = &bufs[round % REC_NBUFS];
+	if (atomic_load_explicit(&b->filled, memory_order_acquire) ==
+	    REC_BUF_EVENTS) {
+	    rec_flush(b, round++, REC_BUF_EVENTS);
+	} else if (atomic_load(&stopping)) {
+	    break;
+	} else {
+	    usleep(1000);
+	}
+    }
+
+    end = atomic_load(&seq);
+    for (; round * REC_BUF_EVENTS < end; round++) {
+	b = &bufs[round % REC_NBUFS];
+	n = end - round * REC_BUF_EVENTS;
+	if (n > REC_BUF_EVENTS)
+	    n = REC_BUF_EVENTS;
+	for (i = 0; i < REC_FLUSH_WAIT && atomic_load(&b->filled) < n; i++)
+	    usleep(1000);
+	rec_flush(b, round, n);
+    }
+    return arg;
+}
+
+/*
+ * rec_flush - write the first n events of buffer b and hand it to the
+ *     callers of the next lap.  The buffer is cleared so that a slot
+ *     that was claimed but never filled in reads as an empty event.
+ */
+static void rec_flush(rec_buf_t *b, unsigned long round, unsigned long n)
+{
+    char *p = (char *)b->ev;
+    size_t left = n * sizeof(rec_event_t);
+    ssize_t cnt;
+
+    while (left > 0) {
+	if ((cnt = write(fd, p, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    perror("mmrecord: write");
+	    break;
+	}
+	p += cnt;
+	left -= cnt;
+    }
+    memset(b->ev, 0, n * sizeof(rec_event_t));
+    atomic_store(&b->filled, 0);
+    atomic_store_explicit(&b->round, round + REC_NBUFS, memory_order_release);
+}
+
+/*
+ * The allocator entry points.  A free is logged before the block goes
+ * back to libc and a malloc after it comes out, so that an address
+ * that is reused by another thread appears in the right order.
+ */
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+
+    if (p != NULL)
+	rec_log(REC_MALLOC, p, NULL, size);
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr != NULL)
+	rec_log(REC_FREE, ptr, NULL, 0);
+    __libc_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p = __libc_calloc(nmemb, size);
+
+    if (p != NULL)
+	rec_log(REC_MALLOC, p, NULL, nmemb * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    rec_log(REC_REALLOC_BEGIN, NULL, ptr, size);
+    p = __libc_realloc(ptr, size);
+    rec_log(REC_REALLOC_END, p, ptr, size);
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *p = __libc_memalign(align, size);
+
+    if (p != NULL)
+	rec_log(REC_MALLOC, p, NULL, size);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align % sizeof(void *) || (align & (align - 1)))
+	return EINVAL;
+    if ((p = memalign(align, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(getpagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = getpagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
@@ -0,0 +1,40 @@
+/*
+ * mmrecord.h - binary log format shared by the allocation recorder
+ *              (mmrecord.c, built as librecord.so) and the converter
+ *              that turns a log into an mdriver trace (rec2rep.c).
+ *
+ * A log is a rec_header_t followed by rec_event_t records in the order
+ * the calls happened.  A realloc is logged as a REC_REALLOC_BEGIN
+ * before the real call and a REC_REALLOC_END after it, so that any
+ * other thread reusing the old block or handing over the new one is
+ * ordered correctly around it.
+ */
+#ifndef __MMRECORD_H_
+#define __MMRECORD_H_
+
+#include <stdint.h>
+
+#define REC_MAGIC "MMREC01"
+
+enum {
+    REC_MALLOC = 1,        /* ptr = new block, size = request */
+    REC_FREE,              /* ptr = freed block */
+    REC_REALLOC_BEGIN,     /* old = block being resized */
+    REC_REALLOC_END        /* ptr = new block (0 if it failed), old, size */
+};
+
+typedef struct {
+    char magic[8];          /* REC_MAGIC */
+    uint32_t event_size;    /* sizeof(rec_event_t) */
+    uint32_t pid;           /* recorded process */
+} rec_header_t;
+
+typedef struct {
+    uint64_t ptr;
+    uint64_t old;
+    uint64_t size;
+    uint32_t type;          /* REC_xxx */
+    uint32_t tid;           /* small per-thread number, from 0 */
+} rec_event_t;
+
+#endif /* __MMRECORD_H_ */
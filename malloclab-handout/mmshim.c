@@ -0,0 +1,128 @@
+/*
+ * mmshim.c - 用 mm.c 实现标准的 malloc/free/realloc/calloc/memalign 等函数。
+ *     和 mm.c、memlib.c 一起编译成 libmm.so（make libmm.so），用 LD_PRELOAD
+ *     替换真实程序中的 libc malloc，例如
+ *
+ *         LD_PRELOAD=./libmm.so ../proxylab-handout/proxy 15213
+ *
+ *     第一次调用时才初始化 memlib 和 mm。mm.c 以 MM_THREADS 编译，每个线程
+ *     使用自己的 arena，多线程程序也可以用。有效载荷按 8 字节对齐
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static int shim_ready; // mm_init 成功
+
+static void shim_init(void) {
+  mem_init();
+  shim_ready = mm_init() == 0;
+}
+
+/*
+ * shim_enter - 保证 mm 已经初始化，初始化失败返回 0
+ */
+static int shim_enter(void) {
+  pthread_once(&shim_once, shim_init);
+  return shim_ready;
+}
+
+/*
+ * shim_result - 分配失败时按 malloc 的约定设置 errno
+ */
+static void *shim_result(void *p) {
+  if (p == NULL) {
+    errno = ENOMEM;
+  }
+  return p;
+}
+
+void *malloc(size_t size) {
+  if (!shim_enter()) {
+    return shim_result(NULL);
+  }
+  // malloc(0) 也要返回一个可以交给 free 的指针
+  return shim_result(mm_malloc(size ? size : 1));
+}
+
+void free(void *ptr) {
+  // 非空的指针一定来自 mm，这时已经初始化过了
+  if (ptr != NULL) {
+    mm_free(ptr);
+  }
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return malloc(size);
+  }
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+  // 和 glibc 一样，超过 PTRDIFF_MAX 的大小直接失败，原来的块不动
+  if (size > PTRDIFF_MAX) {
+    return shim_result(NULL);
+  }
+  return shim_result(mm_realloc(ptr, size));
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  if (!shim_enter()) {
+    return shim_result(NULL);
+  }
+  if (nmemb == 0 || size == 0) {
+    nmemb = size = 1;
+  }
+  return shim_result(mm_calloc(nmemb, size));
+}
+
+void *memalign(size_t align, size_t size) {
+  if (align == 0 || (align & (align - 1))) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (!shim_enter()) {
+    return shim_result(NULL);
+  }
+  return shim_result(mm_memalign(align, size ? size : 1));
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size) {
+  void *p;
+  // 对齐必须是 sizeof(void *) 的倍数，并且是 2 的幂（0 不是）
+  if (align == 0 || align % sizeof(void *) || (align & (align - 1))) {
+    return EINVAL;
+  }
+  if (!shim_enter() || (p = mm_memalign(align, size ? size : 1)) == NULL) {
+    return ENOMEM;
+  }
+  *memptr = p;
+  return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+  return memalign(align, size);
+}
+
+void *valloc(size_t size) {
+  return memalign(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size) {
+  size_t page = mem_pagesize();
+  return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+/*
+ * malloc_usable_size - 块中实际可以使用的字节数，可能比申请的多
+ */
+size_t malloc_usable_size(void *ptr) {
+  return ptr != NULL ? mm_usable_size(ptr) : 0;
+}
@@ -0,0 +1,527 @@
+/*
+ * mtdriver.c - Multithreaded stress driver for the thread-safe build of
+ *              mm.c (compiled with -DMM_THREADS).
+ *
+ * usage: mtdriver [-hs] [-n <threads>] [-r <runs>] [-x <percent>] <trace>...
+ *
+ * For each thread count 1, 2, 4, ... up to -n (default 64), the driver
+ * starts that many threads against one heap.  Thread k replays trace
+ * k mod N of the N traces given, each with its own block ids; with -s,
+ * the first trace is instead split into one shard per thread by block
+ * id.  A fraction (-x, default 10%) of the frees are handed to the next
+ * thread, which frees the block itself, so that blocks are often freed
+ * by a thread other than the one that allocated them.
+ *
+ * The driver reports the best wall-clock time of -r runs (default 3),
+ * the throughput and its speedup over one thread, and the utilization:
+ * the peak of the live payload summed over all threads, divided by the
+ * peak heap size.  Threads add to the live total in steps of up to
+ * LIVE_SLACK bytes, so the peak is exact to within that per thread.
+ * A handed-over block stays live until the thread it went to frees it.
+ * Every block is tagged at both ends so that a block that is handed
+ * out twice, or overwritten by the allocator, is caught.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+
+#define MAX_THREADS   64
+#define DEFAULT_RUNS   3
+#define DEFAULT_XFREE 10  /* percent of frees handed to another thread */
+#define DRAIN_EVERY   64  /* requests between looks at the mailbox */
+#define LIVE_EVERY    64  /* requests between updates of the live total, */
+#define LIVE_SLACK  4096  /* ... or sooner once a thread has grown this much */
+
+/* Blocks that other threads handed over for this one to free */
+typedef struct {
+    pthread_mutex_t lock;
+    void **ptrs;
+    size_t *sizes;         /* payload of each block, still counted as live */
+    size_t n, cap;
+} mailbox_t;
+
+/* One thread's share of the work, and what it found */
+typedef struct {
+    int id;
+    traceop_t *ops;        /* the requests it replays */
+    int num_ops;
+    int num_reqs;          /* ... counting each block of a batch */
+    int num_ids;
+    char **blocks;         /* its live blocks, by id */
+    size_t *block_sizes;
+    unsigned seed;         /* picks the frees to hand over */
+    unsigned long errors;  /* corrupted blocks it found */
+    struct timespec start; /* when it began its requests */
+    struct timespec end;   /* ... and finished them */
+    mailbox_t box;
+} __attribute__((aligned(64))) worker_t; /* no false sharing between them */
+
+static worker_t workers[MAX_THREADS];
+static int nthreads;                /* threads in the current run */
+static int xfree = DEFAULT_XFREE;
+static pthread_barrier_t start_line;
+static atomic_long live_bytes;      /* payload live over all threads */
+static atomic_long peak_bytes;      /* ... and its peak in this run */
+
+static void setup_workers(trace_t **traces, int ntraces, int shard);
+static void shard_trace(trace_t *trace);
+static double run(double *util, unsigned long *errors);
+static void *worker(void *arg);
+static void tag(worker_t *w, int index);
+static int check(worker_t *w, int index, size_t size);
+static void hand_over(worker_t *to, void *p, size_t size);
+static long drain(worker_t *w);
+static void add_live(long delta);
+static void usage(void);
+static void app_error(char *msg);
+
+int main(int argc, char **argv)
+{
+    trace_t *traces[MAX_THREADS];
+    int ntraces, max_threads = MAX_THREADS, runs = DEFAULT_RUNS;
+    int shard = 0, i, c, total_errors = 0;
+    double secs, best, util, best_util = 0, base_kops = 0, kops;
+    unsigned long errors;
+    long reqs;
+
+    while ((c = getopt(argc, argv, "hsn:r:x:")) != EOF) {
+	switch (c) {
+	case 's': /* Split the first trace among the threads */
+	    shard = 1;
+	    break;
+	case 'n': /* Largest number of threads */
+	    max_threads = atoi(optarg);
+	    if (max_threads < 1 || max_threads > MAX_THREADS)
+		app_error("thread count must be between 1 and 64");
+	    break;
+	case 'r': /* Runs per thread count */
+	    if ((runs = atoi(optarg)) < 1)
+		app_error("need at least one run");
+	    break;
+	case 'x': /* Percent of frees done by another thread */
+	    xfree = atoi(optarg);
+	    if (xfree < 0 || xfree > 100)
+		app_error("-x takes a percentage");
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    ntraces = argc - optind;
+    if (ntraces < 1) {
+	usage();
+	exit(1);
+    }
+    if (ntraces > MAX_THREADS)
+	ntraces = MAX_THREADS;
+    for (i = 0; i < ntraces; i++)
+	traces[i] = read_trace("", argv[optind + i]);
+    for (i = 0; i < MAX_THREADS; i++)
+	pthread_mutex_init(&workers[i].box.lock, NULL);
+
+    printf("%s %d trace%s on up to %d threads (%ld CPUs), "
+	   "%d%% of frees by another thread\n",
+	   shard ? "Sharding" : "Replaying", shard ? 1 : ntraces,
+	   (shard || ntraces == 1) ? "" : "s", max_threads,
+	   sysconf(_SC_NPROCESSORS_ONLN), xfree);
+    printf("%7s%10s%10s%9s%9s%6s%8s\n",
+	   "threads", "ops", "secs", "Kops", "speedup", "util", "errors");
+
+    for (nthreads = 1; ; nthreads *= 2) {
+	if (nthreads > max_threads)
+	    nthreads = max_threads;
+	setup_workers(traces, ntraces, shard);
+	best = 0;
+	errors = 0;
+	for (i = 0; i < runs; i++) {
+	    secs = run(&util, &errors);
+	    if (best == 0 || secs < best) {
+		best = secs;
+		best_util = util;
+	    }
+	}
+	for (reqs = 0, i = 0; i < nthreads; i++)
+	    reqs += workers[i].num_reqs;
+	kops = reqs / 1e3 / best;
+	if (base_kops == 0)
+	    base_kops = kops;
+	printf("%7d%10ld%10.6f%9.0f%9.2f%5.0f%%%8lu\n", nthreads, reqs,
+	       best, kops, kops / base_kops, best_util * 100.0, errors);
+	total_errors += errors;
+	if (nthreads == max_threads)
+	    break;
+    }
+
+    if (total_errors) {
+	printf("Found %d corrupted blocks\n", total_errors);
+	exit(1);
+    }
+    return 0;
+}
+
+/*
+ * setup_workers - give each of the nthreads workers its requests and
+ *     its arrays of block pointers and sizes
+ */
+static void setup_workers(trace_t **traces, int ntraces, int shard)
+{
+    worker_t *w;
+    trace_t *t;
+    int i;
+
+    for (i = 0; i < nthreads; i++) {
+	w = &workers[i];
+	if (shard == 0) {
+	    t = traces[i % ntraces];
+	    w->ops = t->ops;
+	    w->num_ops = t->num_ops;
+	    w->num_reqs = t->num_reqs;
+	    w->num_ids = t->num_ids;
+	}
+	w->id = i;
+    }
+    if (shard)
+	shard_trace(traces[0]);
+
+    for (i = 0; i < nthreads; i++) {
+	w = &workers[i];
+	free(w->blocks);
+	free(w->block_sizes);
+	w->blocks = calloc(w->num_ids ? w->num_ids : 1, sizeof(char *));
+	w->block_sizes = calloc(w->num_ids ? w->num_ids : 1, sizeof(size_t));
+	if (w->blocks == NULL || w->block_sizes == NULL)
+	    app_error("calloc failed in setup_workers");
+    }
+}
+
+/*
+ * shard_trace - split trace among the nthreads workers.  Block id i
+ *     goes to worker i mod nthreads, except that the ids of a batch
+ *     request all go with its first id.  Each worker numbers its ids
+ *     densely in the order it first sees them, so its block arrays are
+ *     no larger than its share.
+ */
+static void shard_trace(trace_t *trace)
+{
+    int *owner, *local;
+    int i, j, k, n;
+    traceop_t *op, *out;
+    worker_t *w;
+
+    owner = malloc(trace->num_ids * sizeof(int));
+    local = malloc(trace->num_ids * sizeof(int));
+    if (owner == NULL || local == NULL)
+	app_error("malloc failed in shard_trace");
+    for (i = 0; i < trace->num_ids; i++)
+	owner[i] = local[i] = -1;
+
+    /* Assign ids to workers and count each worker's requests */
+    for (k = 0; k < nthreads; k++) {
+	workers[k].num_ops = workers[k].num_reqs = workers[k].num_ids = 0;
+	if (workers[k].ops != NULL && workers[k].ops != trace->ops)
+	    free(workers[k].ops);
+	workers[k].ops = NULL;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	n = (op->type == BATCH_ALLOC || op->type == BATCH_FREE) ?
+	    op->count : 1;
+	if (owner[op->index] < 0)
+	    owner[op->index] = op->index % nthreads;
+	w = &workers[owner[op->index]];
+	for (j = 0; j < n; j++) {
+	    k = op->index + j;
+	    if (owner[k] < 0)
+		owner[k] = w - workers;
+	    /* a batch must be a run of consecutive local ids */
+	    if (local[k] < 0 && (j == 0 || local[k - 1] == w->num_ids - 1))
+		local[k] = w->num_ids++;
+	    if (owner[k] != w - workers || local[k] != local[op->index] + j)
+		app_error("trace cannot be sharded: a batch request covers "
+			  "ids used apart from it");
+	}
+	w->num_ops++;
+	w->num_reqs += n;
+    }
+
+    /* Copy each request to its worker, renumbered */
+    for (k = 0; k < nthreads; k++) {
+	w = &workers[k];
+	if ((w->ops = malloc((w->num_ops + 1) * sizeof(traceop_t))) == NULL)
+	    app_error("malloc failed in shard_trace");
+	w->num_ops = 0;
+    }
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	w = &workers[owner[op->index]];
+	out = &w->ops[w->num_ops++];
+	*out = *op;
+	out->index = local[op->index];
+    }
+    free(owner);
+    free(local);
+}
+
+/*
+ * run - replay the workers' requests once on nthreads threads against
+ *     a fresh heap.  Returns the elapsed seconds, sets *util and adds
+ *     the corrupted blocks found to *errors.
+ */
+static double run(double *util, unsigned long *errors)
+{
+    pthread_t tid[MAX_THREADS];
+    worker_t *w;
+    double first = 0, last = 0, t;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed");
+    atomic_store(&live_bytes, 0);
+    atomic_store(&peak_bytes, 0);
+    if (pthread_barrier_init(&start_line, NULL, nthreads) != 0)
+	app_error("pthread_barrier_init failed");
+
+    for (i = 0; i < nthreads; i++) {
+	w = &workers[i];
+	w->seed = i + 1;
+	w->errors = 0;
+	w->box.n = 0;
+	if (pthread_create(&tid[i], NULL, worker, w) != 0)
+	    app_error("pthread_create failed");
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tid[i], NULL);
+    pthread_barrier_destroy(&start_line);
+
+    /* 
+     * The run lasts from the first thread's start to the last one's
+     * end; the threads stamp these themselves, since with fewer CPUs
+     * than threads they may finish before this one runs again.
+     */
+    for (i = 0; i < nthreads; i++) {
+	w = &workers[i];
+	t = w->start.tv_sec + w->start.tv_nsec / 1e9;
+	if (i == 0 || t < first)
+	    first = t;
+	t = w->end.tv_sec + w->end.tv_nsec / 1e9;
+	if (t > last)
+	    last = t;
+    }
+
+    /* Blocks handed over after their new owner finished */
+    for (i = 0; i < nthreads; i++) {
+	add_live(-drain(&workers[i]));
+	*errors += workers[i].errors;
+    }
+
+    *util = (double)atomic_load(&peak_bytes) / mem_peak_heapsize();
+    return last - first;
+}
+
+/*
+ * worker - thread body: replay w's requests, handing some of its frees
+ *     to the next thread and freeing what the previous one handed over
+ */
+static void *worker(void *arg)
+{
+    worker_t *w = arg;
+    worker_t *next = &workers[(w->id + 1) % nthreads];
+    traceop_t *op;
+    char *p;
+    size_t size;
+    long live = 0;
+    int i, j;
+
+    pthread_barrier_wait(&start_line);
+    clock_gettime(CLOCK_MONOTONIC, &w->start);
+    for (i = 0; i < w->num_ops; i++) {
+	op = &w->ops[i];
+	switch (op->type) {
+
+	case ALLOC: /* mm_malloc */
+	    if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc failed");
+	    w->blocks[op->index] = p;
+	    w->block_sizes[op->index] = op->size;
+	    tag(w, op->index);
+	    live += op->size;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    size = w->block_sizes[op->index];
+	    if (w->blocks[op->index] != NULL)
+		check(w, op->index, size);
+	    if ((p = mm_realloc(w->blocks[op->index], op->size)) == NULL)
+		app_error("mm_realloc failed");
+	    /* The first byte must have moved with the block */
+	    if (w->blocks[op->index] != NULL &&
+		(unsigned char)p[0] != (op->index & 0xFF))
+		w->errors++;
+	    w->blocks[op->index] = p;
+	    w->block_sizes[op->index] = op->size;
+	    tag(w, op->index);
+	    live += (long)op->size - (long)size;
+	    break;
+
+	case FREE: /* mm_free, here or in the next thread */
+	    p = w->blocks[op->index];
+	    if (p == NULL)
+		break;
+	    check(w, op->index, w->block_sizes[op->index]);
+	    w->blocks[op->index] = NULL;
+	    w->seed = w->seed * 1103515245 + 12345;
+	    if (next != w && (int)((w->seed >> 16) % 100) < xfree) {
+		hand_over(next, p, w->block_sizes[op->index]);
+	    } else {
+		mm_free(p);
+		live -= w->block_sizes[op->index];
+	    }
+	    break;
+
+	case BATCH_ALLOC: /* mm_malloc_batch */
+	    if (mm_malloc_batch(op->size, op->count,
+				(void **)&w->blocks[op->index]) !=
+		(size_t)op->count)
+		app_error("mm_malloc_batch failed");
+	    for (j = 0; j < op->count; j++) {
+		w->block_sizes[op->index + j] = op->size;
+		tag(w, op->index + j);
+	    }
+	    live += (long)op->size * op->count;
+	    break;
+
+	case BATCH_FREE: /* mm_free_batch */
+	    for (j = 0; j < op->count; j++) {
+		if (w->blocks[op->index + j] != NULL) {
+		    check(w, op->index + j, w->block_sizes[op->index + j]);
+		    live -= w->block_sizes[op->index + j];
+		}
+	    }
+	    mm_free_batch((void **)&w->blocks[op->index], op->count);
+	    memset(&w->blocks[op->index], 0, op->count * sizeof(char *));
+	    break;
+
+	default:
+	    app_error("Nonexistent request type");
+	}
+
+	if (i % DRAIN_EVERY == 0)
+	    live -= drain(w);
+	if (live >= LIVE_SLACK || i % LIVE_EVERY == 0) {
+	    add_live(live);
+	    live = 0;
+	}
+    }
+    live -= drain(w);
+    add_live(live);
+    clock_gettime(CLOCK_MONOTONIC, &w->end);
+    return NULL;
+}
+
+/*
+ * tag - mark the first and last byte of block index with its id
+ */
+static void tag(worker_t *w, int index)
+{
+    char *p = w->blocks[index];
+
+    p[0] = p[w->block_sizes[index] - 1] = index & 0xFF;
+}
+
+/*
+ * check - make sure block index still has its tags
+ */
+static int check(worker_t *w, int index, size_t size)
+{
+    unsigned char *p = (unsigned char *)w->blocks[index];
+
+    if (p[0] != (index & 0xFF) || p[size - 1] != (index & 0xFF)) {
+	w->errors++;
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * hand_over - put p, with a payload of size bytes, in to's mailbox for
+ *     it to free
+ */
+static void hand_over(worker_t *to, void *p, size_t size)
+{
+    mailbox_t *box = &to->box;
+
+    pthread_mutex_lock(&box->lock);
+    if (box->n == box->cap) {
+	box->cap = box->cap ? 2 * box->cap : 256;
+	if ((box->ptrs = realloc(box->ptrs, box->cap * sizeof(void *))) == NULL ||
+	    (box->sizes = realloc(box->sizes, box->cap * sizeof(size_t))) == NULL)
+	    app_error("realloc failed in hand_over");
+    }
+    box->ptrs[box->n] = p;
+    box->sizes[box->n++] = size;
+    pthread_mutex_unlock(&box->lock);
+}
+
+/*
+ * drain - free the blocks in w's mailbox and return their payload,
+ *     which stops being live only now
+ */
+static long drain(worker_t *w)
+{
+    mailbox_t *box = &w->box;
+    long freed = 0;
+    size_t i;
+
+    pthread_mutex_lock(&box->lock);
+    for (i = 0; i < box->n; i++) {
+	mm_free(box->ptrs[i]);
+	freed += box->sizes[i];
+    }
+    box->n = 0;
+    pthread_mutex_unlock(&box->lock);
+    return freed;
+}
+
+/*
+ * add_live - add a thread's change in live payload to the total and
+ *     update the peak
+ */
+static void add_live(long delta)
+{
+    long now = atomic_fetch_add(&live_bytes, delta) + delta;
+    long peak = atomic_load(&peak_bytes);
+
+    while (now > peak && !atomic_compare_exchange_weak(&peak_bytes, &peak, now))
+	;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtdriver [-hs] [-n <threads>] [-r <runs>] "
+	    "[-x <percent>] <trace>...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-n <threads>  Scale up to this many threads (1-64).\n");
+    fprintf(stderr, "\t-r <runs>     Report the best of this many runs.\n");
+    fprintf(stderr, "\t-s            Split the first trace among the threads.\n");
+    fprintf(stderr, "\t-x <percent>  Hand this share of the frees to another thread.\n");
+}
+
+static void app_error(char *msg)
+{
+    printf("%s\n", msg);
+    exit(1);
+}
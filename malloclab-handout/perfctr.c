@@ -0,0 +1,145 @@
+/*
+ * perfctr.c - Count hardware events while a test function runs
+ *
+ * Each event gets its own counter, opened disabled on first use.  The
+ * counters are reset and enabled just before f runs and disabled just
+ * after, and a count is scaled up if the kernel had to multiplex the
+ * counter with others for part of the run.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perfctr.h"
+
+static int fds[NUM_COUNTERS]; /* -1 if the counter could not be opened */
+static int opened = 0;
+
+static void open_counters(void);
+static void run_once(perf_test_funct f, void *argp, perf_counts_t *counts);
+
+/*
+ * perf_measure - Run f(argp) n times and return the counts of the
+ *     fastest run in *counts
+ */
+void perf_measure(perf_test_funct f, void *argp, int n, perf_counts_t *counts)
+{
+    perf_counts_t run;
+    int i;
+
+    if (!opened)
+	open_counters();
+    for (i = 0; i < n; i++) {
+	run_once(f, argp, &run);
+	if (i == 0 || run.secs < counts->secs)
+	    *counts = run;
+    }
+}
+
+#ifdef __linux__
+
+/* perf_event type and config of each counter */
+static struct {
+    uint32_t type;
+    uint64_t config;
+} events[NUM_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+			 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/*
+ * open_counters - open a disabled counter for each event of this process
+ */
+static void open_counters(void)
+{
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    opened = 1;
+}
+
+/*
+ * run_once - run f(argp) once with the counters on
+ */
+static void run_once(perf_test_funct f, void *argp, perf_counts_t *counts)
+{
+    struct timespec start, end;
+    struct {
+	uint64_t value, enabled, running;
+    } val;
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < NUM_COUNTERS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    f(argp);
+    for (i = 0; i < NUM_COUNTERS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    counts->secs = (end.tv_sec - start.tv_sec) +
+	1e-9 * (end.tv_nsec - start.tv_nsec);
+    for (i = 0; i < NUM_COUNTERS; i++) {
+	counts->count[i] = -1;
+	if (fds[i] < 0 || read(fds[i], &val, sizeof(val)) != sizeof(val) ||
+	    val.running == 0)
+	    continue;
+	counts->count[i] = (double)val.value * val.enabled / val.running;
+    }
+}
+
+#else /* !__linux__ */
+
+static void open_counters(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_COUNTERS; i++)
+	fds[i] = -1;
+    opened = 1;
+}
+
+static void run_once(perf_test_funct f, void *argp, perf_counts_t *counts)
+{
+    struct timespec start, end;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    f(argp);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    counts->secs = (end.tv_sec - start.tv_sec) +
+	1e-9 * (end.tv_nsec - start.tv_nsec);
+    for (i = 0; i < NUM_COUNTERS; i++)
+	counts->count[i] = -1;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,26 @@
+/*
+ * perfctr.h - Count hardware events while a test function runs
+ *
+ * The counters are Linux perf_event counters of the calling process,
+ * user mode only.  Any counter that can't be opened (no PMU, a
+ * restrictive perf_event_paranoid, another OS) reads as -1, and the
+ * elapsed time, taken with clock_gettime, is always there.
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The events that are counted */
+enum {CTR_INSTRUCTIONS, CTR_CYCLES, CTR_L1D_MISSES, CTR_LLC_MISSES,
+      CTR_BRANCH_MISSES, NUM_COUNTERS};
+
+typedef struct {
+    double secs;                /* elapsed time of the run */
+    double count[NUM_COUNTERS]; /* events during it, or -1 if not counted */
+} perf_counts_t;
+
+typedef void (*perf_test_funct)(void *);
+
+/* Run f(argp) n times and return the counts of the fastest run */
+void perf_measure(perf_test_funct f, void *argp, int n, perf_counts_t *counts);
+
+#endif /* __PERFCTR_H_ */
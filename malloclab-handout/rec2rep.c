@@ -0,0 +1,339 @@
+/*
+ * rec2rep.c - turn an allocation log written by librecord.so into a
+ *             trace file for mdriver.
+ *
+ * usage: rec2rep [-o <file.rep>] <log>
+ *
+ * Block addresses in the log are replaced by dense ids in the order the
+ * blocks were allocated, so a trace with n allocations uses ids 0..n-1.
+ * Calls that mdriver cannot replay are adjusted: malloc(0) becomes a
+ * 1-byte request, frees of blocks allocated before recording started
+ * are dropped, and a block still live when its address is handed out
+ * again (its free was never seen) is freed first.  The suggested heap
+ * size in the header is the peak number of live payload bytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "mmrecord.h"
+
+/* A live block: its address, trace id and payload size */
+typedef struct {
+    uint64_t addr;  /* 0 means an empty slot */
+    int id;
+    size_t size;
+} live_t;
+
+/* Summary that the first pass collects for the trace header */
+typedef struct {
+    int num_ids;
+    int num_ops;
+    size_t live_bytes;
+    size_t peak_bytes;
+} summary_t;
+
+/* open addressing hash table of live blocks, keyed by address */
+static live_t *table;
+static size_t table_size;   /* a power of two */
+static size_t table_count;
+
+/* for each thread, the block its unfinished realloc holds (id < 0 if none) */
+static live_t *pending;
+static int num_pending;
+
+static void convert(FILE *in, FILE *out, summary_t *sum);
+static void do_alloc(FILE *out, summary_t *sum, uint64_t addr, size_t size,
+		     int id);
+static void take(summary_t *sum, uint64_t addr, live_t *blk);
+static void do_free(FILE *out, summary_t *sum, uint64_t addr);
+static live_t *lookup(uint64_t addr);
+static void insert(uint64_t addr, int id, size_t size);
+static void delete(live_t *slot);
+static live_t *pending_slot(uint32_t tid);
+static void reset(void);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out = stdout;
+    rec_header_t hdr;
+    summary_t sum;
+    int c;
+
+    while ((c = getopt(argc, argv, "o:h")) != EOF) {
+	switch (c) {
+	case 'o':
+	    if ((out = fopen(optarg, "w")) == NULL) {
+		perror(optarg);
+		exit(1);
+	    }
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind != argc - 1)
+	usage();
+
+    if ((in = fopen(argv[optind], "r")) == NULL) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+	strcmp(hdr.magic, REC_MAGIC) != 0 ||
+	hdr.event_size != sizeof(rec_event_t)) {
+	fprintf(stderr, "%s: not an allocation log\n", argv[optind]);
+	exit(1);
+    }
+
+    /* The header needs the counts, so convert once without output */
+    convert(in, NULL, &sum);
+    fprintf(out, "%lu\n%d\n%d\n1\n",
+	    (unsigned long)sum.peak_bytes, sum.num_ids, sum.num_ops);
+    fseek(in, sizeof(hdr), SEEK_SET);
+    convert(in, out, &sum);
+
+    fclose(in);
+    if (out != stdout)
+	fclose(out);
+    return 0;
+}
+
+/*
+ * convert - read the events that follow the header and write the
+ *     trace requests to out (nothing if out is NULL)
+ */
+static void convert(FILE *in, FILE *out, summary_t *sum)
+{
+    rec_event_t ev;
+    live_t *pend;
+
+    reset();
+    memset(sum, 0, sizeof(*sum));
+    while (fread(&ev, sizeof(ev), 1, in) == 1) {
+	switch (ev.type) {
+	case REC_MALLOC:
+	    do_alloc(out, sum, ev.ptr, ev.size, -1);
+	    break;
+
+	case REC_FREE:
+	    do_free(out, sum, ev.ptr);
+	    break;
+
+	case REC_REALLOC_BEGIN:
+	    /* The block is in flight: its address may be reused by other
+	     * threads before the realloc returns */
+	    take(sum, ev.old, pending_slot(ev.tid));
+	    break;
+
+	case REC_REALLOC_END:
+	    pend = pending_slot(ev.tid);
+	    if (pend->id < 0) /* the realloc began before recording did */
+		take(sum, ev.old, pend);
+	    if (ev.ptr == 0) {
+		/* it failed, so the old block is still there */
+		if (pend->id >= 0) {
+		    insert(ev.old, pend->id, pend->size);
+		    sum->live_bytes += pend->size;
+		}
+	    } else {
+		do_alloc(out, sum, ev.ptr, ev.size, pend->id);
+	    }
+	    pend->id = -1;
+	    break;
+
+	default:
+	    /* a slot the recorder never filled in */
+	    break;
+	}
+    }
+}
+
+/*
+ * do_alloc - record that a block of size bytes now lives at addr.  It
+ *     is a realloc of block id, or a new block if id is negative.
+ */
+static void do_alloc(FILE *out, summary_t *sum, uint64_t addr, size_t size,
+		     int id)
+{
+    /* the previous block at this address was freed without our seeing it */
+    if (lookup(addr) != NULL)
+	do_free(out, sum, addr);
+
+    if (size == 0)
+	size = 1;
+    if (size > INT_MAX) {
+	/* mdriver can't replay it; drop the block */
+	if (id >= 0) {
+	    if (out)
+		fprintf(out, "f %d\n", id);
+	    sum->num_ops++;
+	}
+	return;
+    }
+    if (id < 0) {
+	id = sum->num_ids++;
+	if (out)
+	    fprintf(out, "a %d %lu\n", id, (unsigned long)size);
+    } else if (out) {
+	fprintf(out, "r %d %lu\n", id, (unsigned long)size);
+    }
+    sum->num_ops++;
+    insert(addr, id, size);
+    sum->live_bytes += size;
+    if (sum->live_bytes > sum->peak_bytes)
+	sum->peak_bytes = sum->live_bytes;
+}
+
+/*
+ * do_free - free the block at addr, if it is one we know about
+ */
+static void do_free(FILE *out, summary_t *sum, uint64_t addr)
+{
+    live_t *slot = lookup(addr);
+
+    if (slot == NULL)
+	return;
+    if (out)
+	fprintf(out, "f %d\n", slot->id);
+    sum->num_ops++;
+    sum->live_bytes -= slot->size;
+    delete(slot);
+}
+
+/*
+ * take - move the live block at addr (if any) out of the table into
+ *     *blk, for a realloc that is under way.  blk->id is -1 if there
+ *     is no such block.
+ */
+static void take(summary_t *sum, uint64_t addr, live_t *blk)
+{
+    live_t *slot = lookup(addr);
+
+    blk->id = -1;
+    if (slot == NULL)
+	return;
+    *blk = *slot;
+    sum->live_bytes -= slot->size;
+    delete(slot);
+}
+
+/*
+ * lookup - return the table slot of the live block at addr, or NULL
+ */
+static live_t *lookup(uint64_t addr)
+{
+    size_t i;
+
+    if (table_size == 0)
+	return NULL;
+    for (i = (addr >> 4) & (table_size - 1); table[i].addr != 0;
+	 i = (i + 1) & (table_size - 1)) {
+	if (table[i].addr == addr)
+	    return &table[i];
+    }
+    return NULL;
+}
+
+/*
+ * insert - add a live block, doubling the table when it is half full
+ */
+static void insert(uint64_t addr, int id, size_t size)
+{
+    live_t *old = table;
+    size_t old_size = table_size, i;
+
+    if (2 * (table_count + 1) > table_size) {
+	table_size = table_size ? 2 * table_size : 1024;
+	if ((table = calloc(table_size, sizeof(live_t))) == NULL) {
+	    fprintf(stderr, "rec2rep: out of memory\n");
+	    exit(1);
+	}
+	table_count = 0;
+	for (i = 0; i < old_size; i++) {
+	    if (old[i].addr != 0)
+		insert(old[i].addr, old[i].id, old[i].size);
+	}
+	free(old);
+    }
+    for (i = (addr >> 4) & (table_size - 1); table[i].addr != 0;
+	 i = (i + 1) & (table_size - 1))
+	;
+    table[i].addr = addr;
+    table[i].id = id;
+    table[i].size = size;
+    table_count++;
+}
+
+/*
+ * delete - remove a slot, moving later entries of its probe run back
+ *     so that lookups never stop at the hole
+ */
+static void delete(live_t *slot)
+{
+    size_t mask = table_size - 1;
+    size_t i = slot - table, j = i, home;
+
+    for (;;) {
+	table[i].addr = 0;
+	for (;;) {
+	    j = (j + 1) & mask;
+	    if (table[j].addr == 0) {
+		table_count--;
+		return;
+	    }
+	    home = (table[j].addr >> 4) & mask;
+	    /* table[j] can fill the hole at i unless its home lies
+	     * cyclically in (i, j] */
+	    if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+		continue;
+	    table[i] = table[j];
+	    i = j;
+	    break;
+	}
+    }
+}
+
+/*
+ * pending_slot - return the pending realloc of thread tid
+ */
+static live_t *pending_slot(uint32_t tid)
+{
+    int n = num_pending;
+
+    if ((int)tid >= num_pending) {
+	while ((int)tid >= n)
+	    n = n ? 2 * n : 64;
+	if ((pending = realloc(pending, n * sizeof(live_t))) == NULL) {
+	    fprintf(stderr, "rec2rep: out of memory\n");
+	    exit(1);
+	}
+	while (num_pending < n)
+	    pending[num_pending++].id = -1;
+    }
+    return &pending[tid];
+}
+
+/*
+ * reset - forget all live blocks and pending reallocs
+ */
+static void reset(void)
+{
+    int i;
+
+    if (table != NULL)
+	memset(table, 0, table_size * sizeof(live_t));
+    table_count = 0;
+    for (i = 0; i < num_pending; i++)
+	pending[i].id = -1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: rec2rep [-o <file.rep>] <log>\n");
+    fprintf(stderr, "Convert a librecord.so allocation log to an mdriver trace.\n");
+    exit(1);
+}
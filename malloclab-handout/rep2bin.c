@@ -0,0 +1,24 @@
+/*
+ * rep2bin.c - convert a text (.rep) trace to the binary format that
+ *             mdriver maps instead of parsing (see trace.h).
+ *
+ * usage: rep2bin <in.rep> <out>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+int main(int argc, char **argv)
+{
+    trace_t *trace;
+
+    if (argc != 3) {
+	fprintf(stderr, "usage: %s <in.rep> <out>\n", argv[0]);
+	exit(1);
+    }
+    trace = read_trace("", argv[1]);
+    write_trace(trace, argv[2]);
+    free_trace(trace);
+    return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * trace.c - Read, write and free malloc lab traces.
+ *
+ * read_trace() accepts both formats.  A text (.rep) trace is parsed
+ * into a malloc'd op array.  A binary trace (see trace.h) is mapped
+ * read-only and its op array is used where it lies, so even a trace
+ * with millions of requests is ready as soon as it has been checked.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+static void read_text(trace_t *trace, FILE *tracefile, char *path);
+static void map_binary(trace_t *trace, int fd, char *path);
+static void alloc_blocks(trace_t *trace);
+static void unix_error(char *msg, char *path);
+static void app_error(char *msg, char *path);
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char path[MAXLINE];
+    char magic[8];
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL)
+	unix_error("calloc failed in read_trace", NULL);
+
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((tracefile = fopen(path, "r")) == NULL)
+	unix_error("Could not open", path);
+
+    /* Binary traces start with TRACE_MAGIC, text ones with a number */
+    if (fread(magic, sizeof(magic), 1, tracefile) == 1 &&
+	memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+	map_binary(trace, fileno(tracefile), path);
+    } else {
+	rewind(tracefile);
+	read_text(trace, tracefile, path);
+    }
+    fclose(tracefile);
+
+    alloc_blocks(trace);
+    return trace;
+}
+
+/*
+ * read_text - parse a .rep trace
+ */
+static void read_text(trace_t *trace, FILE *tracefile, char *path)
+{
+    char type[MAXLINE];
+    unsigned index, size, count;
+    unsigned max_index = 0;
+    unsigned op_index;
+
+    /* Read the trace file header */
+    if (fscanf(tracefile, "%d %d %d %d", &trace->sugg_heapsize,
+	       &trace->num_ids, &trace->num_ops, &trace->weight) != 4)
+	app_error("Bad header in trace", path);
+
+    /* We'll store each request line in the trace in this array; it is
+     * zeroed so the fields an op doesn't use (count, or size for a
+     * free) are written out by write_trace() as 0 */
+    if ((trace->ops =
+	 (traceop_t *)calloc(trace->num_ops, sizeof(traceop_t))) == NULL)
+	unix_error("calloc failed in read_trace", NULL);
+
+    /* read every request line in the trace file */
+    index = 0;
+    op_index = 0;
+    trace->num_reqs = 0;
+    while (fscanf(tracefile, "%s", type) != EOF) {
+	switch(type[0]) {
+	case 'a':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'r':
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    trace->ops[op_index].type = REALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'f':
+	    fscanf(tracefile, "%ud", &index);
+	    trace->ops[op_index].type = FREE;
+	    trace->ops[op_index].index = index;
+	    break;
+	case 'A':
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    trace->ops[op_index].type = BATCH_ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    index += count - 1;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'F':
+	    fscanf(tracefile, "%u %u", &index, &count);
+	    trace->ops[op_index].type = BATCH_FREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n",
+		   type[0], path);
+	    exit(1);
+	}
+	trace->num_reqs += (type[0] == 'A' || type[0] == 'F') ?
+	    trace->ops[op_index].count : 1;
+	op_index++;
+
+    }
+    assert(max_index == trace->num_ids - 1);
+    assert(trace->num_ops == op_index);
+}
+
+/*
+ * map_binary - map a binary trace and check that its ops are usable
+ */
+static void map_binary(trace_t *trace, int fd, char *path)
+{
+    trace_header_t *hdr;
+    traceop_t *op;
+    struct stat st;
+    int i;
+
+    if (fstat(fd, &st) < 0)
+	unix_error("Could not stat", path);
+    if ((size_t)st.st_size < sizeof(trace_header_t))
+	app_error("Truncated trace", path);
+    trace->map_len = st.st_size;
+    trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->map == MAP_FAILED)
+	unix_error("Could not map", path);
+
+    hdr = (trace_header_t *)trace->map;
+    if (hdr->op_size != sizeof(traceop_t))
+	app_error("Trace was written by an incompatible driver", path);
+    if (hdr->num_ops < 0 || hdr->num_ids < 0 ||
+	(trace->map_len - sizeof(trace_header_t)) / sizeof(traceop_t) <
+	(size_t)hdr->num_ops)
+	app_error("Truncated trace", path);
+    trace->sugg_heapsize = hdr->sugg_heapsize;
+    trace->num_ids = hdr->num_ids;
+    trace->num_ops = hdr->num_ops;
+    trace->num_reqs = hdr->num_reqs;
+    trace->weight = hdr->weight;
+    trace->ops = (traceop_t *)(hdr + 1);
+
+    /* The ops index the block arrays directly, so check them once here */
+    for (i = 0; i < trace->num_ops; i++) {
+	op = &trace->ops[i];
+	if ((unsigned)op->type > BATCH_FREE)
+	    app_error("Op with a bad type in trace", path);
+	if (op->index < 0 || op->index >= trace->num_ids ||
+	    ((op->type == BATCH_ALLOC || op->type == BATCH_FREE) &&
+	     (op->count < 0 || op->count > trace->num_ids - op->index)))
+	    app_error("Op with a bad index in trace", path);
+	if (op->type != FREE && op->type != BATCH_FREE && op->size < 0)
+	    app_error("Op with a bad size in trace", path);
+    }
+    madvise(trace->map, trace->map_len, MADV_SEQUENTIAL);
+}
+
+/*
+ * alloc_blocks - allocate the per-id arrays the evaluation routines use
+ */
+static void alloc_blocks(trace_t *trace)
+{
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc failed in read_trace", NULL);
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc failed in read_trace", NULL);
+}
+
+/*
+ * write_trace - write trace to path in the binary format
+ */
+void write_trace(trace_t *trace, char *path)
+{
+    FILE *out;
+    trace_header_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    strncpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.op_size = sizeof(traceop_t);
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.num_reqs = trace->num_reqs;
+    hdr.weight = trace->weight;
+
+    if ((out = fopen(path, "w")) == NULL)
+	unix_error("Could not create", path);
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+	fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, out) !=
+	(size_t)trace->num_ops ||
+	fclose(out) != 0)
+	unix_error("Could not write", path);
+}
+
+/*
+ * free_trace - Free the trace record and the arrays it points to,
+ *              all of which were allocated (or mapped) in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+    if (trace->map != NULL)
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);              /* and the trace record itself... */
+}
+
+/*
+ * unix_error - report a failed system call (on path, if given) and exit
+ */
+static void unix_error(char *msg, char *path)
+{
+    if (path != NULL)
+	printf("%s %s: %s\n", msg, path, strerror(errno));
+    else
+	printf("%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * app_error - report a malformed trace and exit
+ */
+static void app_error(char *msg, char *path)
+{
+    printf("%s %s\n", msg, path);
+    exit(1);
+}
@@ -0,0 +1,63 @@
+/*
+ * trace.h - In-memory form of a malloc lab trace, and the routines that
+ *           read it from a text (.rep) or binary trace file.
+ *
+ * A binary trace is a trace_header_t followed by the packed traceop_t
+ * array, so read_trace() maps it and uses the ops in place instead of
+ * parsing them.  rep2bin converts a .rep file to this format.
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Characterizes a single trace operation (allocator request).  The
+ * batch requests cover the count ids index, index+1, ..., and are
+ * served by mm_malloc_batch() and mm_free_batch().
+ */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC, BATCH_ALLOC, BATCH_FREE} type;
+                                      /* type of request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc/realloc request */
+    int count;                        /* number of ids in a batch request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int num_reqs;        /* ... counting each block of a batch request */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc/realloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* the mapped binary file, or NULL if ops was read */
+    size_t map_len;      /* ... and its length */
+} trace_t;
+
+/* Header of a binary trace file; the ops start right after it */
+#define TRACE_MAGIC "MMTRACE"
+
+typedef struct {
+    char magic[8];          /* TRACE_MAGIC */
+    uint32_t op_size;       /* sizeof(traceop_t) */
+    int32_t sugg_heapsize;
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t num_reqs;
+    int32_t weight;
+    uint32_t pad[4];        /* keeps the ops 16-byte aligned */
+} trace_header_t;
+
+_Static_assert(sizeof(trace_header_t) % 16 == 0,
+               "trace_header_t must keep the ops 16-byte aligned");
+
+trace_t *read_trace(char *tracedir, char *filename);
+void write_trace(trace_t *trace, char *path);
+void free_trace(trace_t *trace);
+
+#endif /* __TRACE_H_ */